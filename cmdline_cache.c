@@ -0,0 +1,219 @@
+#include "cmdline_cache.h"
+#include "fd_cache.h"
+#include "string_arena.h"
+
+#define STRINGS_BUCKETS 4096        /* Hash buckets (power of two) */
+
+/* Name and full cmdline of one process, keyed by (pid, starttime) */
+typedef struct strings_entry {
+    pid_t pid;
+    unsigned long long starttime;
+    char name[64];                  /* comm when the cmdline was read */
+    uid_t uid;                      /* Effective uid when it was read */
+    arena_ref_t cmdline;            /* Interned full cmdline (one reference held) */
+    unsigned long stamp;
+    int invalid;                    /* Exec seen; re-read on next use */
+    double last_seen;               /* CLOCK_MONOTONIC seconds */
+    struct strings_entry *next;
+} strings_entry_t;
+
+static strings_entry_t *buckets[STRINGS_BUCKETS];
+static pthread_mutex_t strings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get monotonic time in seconds */
+static double monotonic_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Find the link pointing at a PID's entry (or at the bucket's end) */
+static strings_entry_t** find_link(pid_t pid) {
+    strings_entry_t **link = &buckets[pid & (STRINGS_BUCKETS - 1)];
+    
+    while (*link != NULL && (*link)->pid != pid) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/* Copy the cached cmdline into the inline buffer and hand on its reference */
+static void copy_cmdline(process_info_t *info, const strings_entry_t *entry) {
+    arena_copy(entry->cmdline, info->cmdline, sizeof(info->cmdline));
+    info->cmdline_ref = entry->cmdline;
+    info->cmdline_stamp = entry->stamp;
+    info->uid = entry->uid;
+}
+
+/* Read the whole cmdline, uncapped up to FULL_CMDLINE_MAX; caller frees */
+char* read_full_cmdline(pid_t pid, size_t *length) {
+    size_t capacity = 4096;
+    size_t len = 0;
+    char *buf = (char*)malloc(capacity);
+    ssize_t n;
+    
+    if (buf == NULL) return NULL;
+    
+    for (;;) {
+        n = read_proc_file_at(pid, PROC_FILE_CMDLINE, buf + len, capacity - len - 1, (off_t)len);
+        if (n < 0) {
+            free(buf);
+            return NULL;
+        }
+        len += (size_t)n;
+        
+        /* A short read means we have it all */
+        if (len < capacity - 1 || capacity >= FULL_CMDLINE_MAX) break;
+        
+        char *grown = (char*)realloc(buf, capacity * 2);
+        if (grown == NULL) break;
+        buf = grown;
+        capacity *= 2;
+    }
+    
+    /* Replace null bytes with spaces */
+    while (len > 0 && buf[len - 1] == '\0') len--;
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == '\0') {
+            buf[i] = ' ';
+        }
+    }
+    buf[len] = '\0';
+    
+    if (length != NULL) *length = len;
+    return buf;
+}
+
+/*
+ * Fill info->cmdline from the cache. pid, starttime and name must already
+ * be sampled from stat; the cmdline is only re-read on first sight, PID
+ * reuse, a comm change, or after an exec invalidated the entry, and so is
+ * the owning uid (a setuid exec is an exec). The full
+ * cmdline is interned in the string arena; info gets a truncated copy and
+ * a reference the table can share while the entry holds it.
+ */
+int fill_process_strings(process_info_t *info) {
+    strings_entry_t *entry;
+    char *cmdline;
+    size_t length = 0;
+    arena_ref_t ref;
+    unsigned long stamp = 0;
+    struct stat st;
+    
+    pthread_mutex_lock(&strings_lock);
+    
+    entry = *find_link(info->pid);
+    if (entry != NULL && !entry->invalid && entry->starttime == info->starttime &&
+        strcmp(entry->name, info->name) == 0) {
+        copy_cmdline(info, entry);
+        entry->last_seen = monotonic_now();
+        pthread_mutex_unlock(&strings_lock);
+        return 0;
+    }
+    
+    pthread_mutex_unlock(&strings_lock);
+    
+    /* Miss: read and intern outside the lock */
+    info->cmdline_ref = 0;
+    info->uid = stat_proc_dir(info->pid, &st) == 0 ? st.st_uid : (uid_t)-1;
+    cmdline = read_full_cmdline(info->pid, &length);
+    if (cmdline == NULL) {
+        info->cmdline[0] = '\0';
+        return -1;
+    }
+    ref = arena_intern(cmdline, length, &stamp);
+    if (ref == 0) {
+        /* Arena unavailable: inline copy only, nothing cached */
+        snprintf(info->cmdline, sizeof(info->cmdline), "%s", cmdline);
+        free(cmdline);
+        return 0;
+    }
+    free(cmdline);
+    
+    pthread_mutex_lock(&strings_lock);
+    
+    entry = *find_link(info->pid);
+    if (entry == NULL) {
+        entry = (strings_entry_t*)calloc(1, sizeof(strings_entry_t));
+        if (entry == NULL) {
+            pthread_mutex_unlock(&strings_lock);
+            arena_release(ref);
+            info->cmdline[0] = '\0';
+            return -1;
+        }
+        entry->pid = info->pid;
+        entry->next = buckets[info->pid & (STRINGS_BUCKETS - 1)];
+        buckets[info->pid & (STRINGS_BUCKETS - 1)] = entry;
+    }
+    
+    arena_release(entry->cmdline);
+    entry->cmdline = ref;
+    entry->stamp = stamp;
+    entry->starttime = info->starttime;
+    entry->uid = info->uid;
+    memcpy(entry->name, info->name, sizeof(entry->name));
+    entry->invalid = 0;
+    entry->last_seen = monotonic_now();
+    copy_cmdline(info, entry);
+    
+    pthread_mutex_unlock(&strings_lock);
+    return 0;
+}
+
+/* Force a re-read on next use (exec seen) */
+void invalidate_process_strings(pid_t pid) {
+    pthread_mutex_lock(&strings_lock);
+    
+    strings_entry_t *entry = *find_link(pid);
+    if (entry != NULL) {
+        entry->invalid = 1;
+    }
+    
+    pthread_mutex_unlock(&strings_lock);
+}
+
+/* Unlink and free the entry behind a link */
+static void free_entry(strings_entry_t **link) {
+    strings_entry_t *entry = *link;
+    
+    *link = entry->next;
+    arena_release(entry->cmdline);
+    free(entry);
+}
+
+/* Drop the entry of an exited process */
+void forget_process_strings(pid_t pid) {
+    pthread_mutex_lock(&strings_lock);
+    
+    strings_entry_t **link = find_link(pid);
+    if (*link != NULL) {
+        free_entry(link);
+    }
+    
+    pthread_mutex_unlock(&strings_lock);
+}
+
+/* Drop entries of processes not seen for max_age seconds */
+void prune_process_strings(double max_age) {
+    double now = monotonic_now();
+    
+    pthread_mutex_lock(&strings_lock);
+    
+    for (int i = 0; i < STRINGS_BUCKETS; i++) {
+        strings_entry_t **link = &buckets[i];
+        while (*link != NULL) {
+            if (now - (*link)->last_seen > max_age) {
+                free_entry(link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&strings_lock);
+}
+
+/* Free every entry */
+void cleanup_process_strings(void) {
+    prune_process_strings(-1.0);
+}
@@ -0,0 +1,17 @@
+#ifndef CMDLINE_CACHE_H
+#define CMDLINE_CACHE_H
+
+#include "common.h"
+
+#define STRINGS_MAX_AGE 120.0       /* Seconds before an unseen entry is dropped */
+#define FULL_CMDLINE_MAX (1024 * 1024)
+
+/* Cmdline Cache Functions */
+int fill_process_strings(process_info_t *info);
+void invalidate_process_strings(pid_t pid);
+void forget_process_strings(pid_t pid);
+void prune_process_strings(double max_age);
+void cleanup_process_strings(void);
+char* read_full_cmdline(pid_t pid, size_t *length);
+
+#endif /* CMDLINE_CACHE_H */
@@ -7,9 +7,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
-#include <sys/shm.h>
+#include <sys/mman.h>
 #include <sys/msg.h>
-#include <sys/sem.h>
 #include <sys/wait.h>
 #include <pthread.h>
 #include <dirent.h>
@@ -20,12 +19,15 @@
 #include <ctype.h>
 
 /* Constants */
-#define MAX_PROCESSES 4096
+#define TABLE_INITIAL_CAPACITY 1024      /* Slots when the segment is created */
+#define TABLE_DEFAULT_MAX_CAPACITY 262144 /* Bound unless PSX_MAX_PROCESSES / -m says otherwise */
+#define TABLE_SHARDS 16
+#define SHARD_SLOTS 256           /* Slots per range; range r uses shard r % TABLE_SHARDS */
+#define TABLE_COMPACT_STEP 1024   /* Trailing tombstones trimmed per background step */
 #define MAX_CMD_LEN 256
 #define MAX_PATH_LEN 512
-#define SHM_KEY 0x12345
+#define TABLE_SHM_NAME "/psx_table"
 #define MSG_KEY 0x54321
-#define SEM_KEY 0xABCDE
 #define LOG_FILE "psx_log.txt"
 #define STATS_FILE "psx_stats.log"
 
@@ -38,6 +40,9 @@ typedef enum {
     PROC_DEAD
 } proc_state_t;
 
+/* Offset of an interned string in the shared string arena (0: none) */
+typedef unsigned long arena_ref_t;
+
 /* Process Information Structure */
 typedef struct {
     pid_t pid;
@@ -47,20 +52,181 @@ typedef struct {
     proc_state_t state;
     unsigned long utime;      // User time
     unsigned long stime;      // System time
+    unsigned long long starttime; // Start time after boot (clock ticks)
     unsigned long vsize;      // Virtual memory size
     long rss;                 // Resident set size (KB)
     double cpu_percent;       // CPU usage percentage
     double mem_percent;       // Memory usage percentage
     time_t last_update;
     int is_zombie;
+    int dirty;                // Changed (exec/comm) and due for re-sampling
+    uid_t uid;                // Effective uid (owner of /proc/<pid>)
+    arena_ref_t name_ref;     // Interned name in the string arena (not owned; set by reads only)
+    arena_ref_t cmdline_ref;  // Full cmdline in the string arena (not owned)
+    unsigned long cmdline_stamp; // Identifies that string for arena_retain()
 } process_info_t;
 
-/* Process Table Structure */
+/* Per-scan System Values (read once per scan, not once per PID) */
+typedef struct {
+    long clk_tck;             // Clock ticks per second
+    long ncpus;               // Online CPUs
+    long page_size_kb;        // Page size (KB)
+    unsigned long total_ram_kb; // Total RAM (KB)
+    double uptime;            // Seconds since boot
+} system_snapshot_t;
+
+/* PID -> slot index entry (pid 0 marks an empty bucket) */
 typedef struct {
-    int count;
-    process_info_t processes[MAX_PROCESSES];
+    pid_t pid;
+    int slot;
+} pid_index_entry_t;
+
+/* Lock Wait Counters (updated atomically, readable by clients) */
+typedef struct {
+    unsigned long long acquisitions;
+    unsigned long long contended;     /* Acquisitions that had to wait */
+    unsigned long long wait_ns;       /* Total time spent waiting */
+    unsigned long long max_wait_ns;
+    unsigned long long hold_ns;       /* Total time the lock was held */
+    unsigned long long max_hold_ns;
+    unsigned long long owner_died;    /* Recovered from a dead holder */
+} lock_stats_t;
+
+/* Slot-range Shard: guards in-place writes to its entries */
+typedef struct {
+    pthread_mutex_t lock;     /* Process-shared, robust */
+    unsigned int seq;         /* Seqlock: odd while a shard writer is active */
+    unsigned long long held_since_ns; /* CLOCK_MONOTONIC time of the current acquisition */
+} table_shard_t;
+
+/* Cold Record: fields read only per process; strings live in the arena */
+typedef struct {
+    arena_ref_t name;         /* Interned: equal names share one offset */
+    arena_ref_t cmdline;      /* Interned, full length */
+    unsigned long long starttime;
+    unsigned long vsize;
+    uid_t uid;
+    int is_zombie;
+} process_cold_t;
+
+/*
+ * Table Columns. The fields that sweeps over the whole table read are hot
+ * columns, each one contiguous array; the rest of an entry is a cold record.
+ * All of them, then the PID index, follow the header back to back, each
+ * sized for the current capacity.
+ */
+typedef enum {
+    COL_PID,                  /* pid_t */
+    COL_PPID,                 /* pid_t */
+    COL_STATE,                /* proc_state_t */
+    COL_UTIME,                /* unsigned long */
+    COL_STIME,                /* unsigned long */
+    COL_RSS,                  /* long */
+    COL_CPU_PERCENT,          /* double */
+    COL_MEM_PERCENT,          /* double */
+    COL_LAST_UPDATE,          /* time_t */
+    COL_DIRTY,                /* unsigned char */
+    COL_COLD,                 /* process_cold_t */
+    COL_FREE,                 /* int: min-heap of tombstoned slots */
+    COL_INDEX,                /* pid_index_entry_t, index_size entries */
+    TABLE_COLUMNS
+} table_column_t;
+
+#define SCHEDULER_LAG_BUCKETS 26    /* Lag histogram: bucket b counts lags below 2^b us, the last one the rest */
+
+/* Scheduler Counters (in the segment, so clients can show them) */
+typedef struct {
+    char policy[16];          /* Priority policy name */
+    double budget;            /* Refresh samples per second allowed */
+    double demand;            /* Samples per second the policy asks for */
+    double stretch;           /* Factor intervals are lengthened by to fit the budget */
+    unsigned long long samples;  /* Refreshes taken */
+    int tracked;              /* Processes with a refresh timer */
+    int workers;              /* Refresh worker threads */
+    int pinned;               /* Workers are pinned to CPUs */
+    unsigned long long steals;   /* Chunks a worker took from another's queue */
+    unsigned long long missed;   /* Refreshes sampled later than SCHEDULER_MISS_SECS */
+    unsigned long long max_lag_ns;
+    unsigned long long lag_buckets[SCHEDULER_LAG_BUCKETS];  /* Sample time minus deadline */
+} scheduler_stats_t;
+
+#define ZOMBIE_TOP_HOLDERS 8        /* Parents listed in the zombie counters */
+
+/* A parent holding unreaped zombies */
+typedef struct {
+    pid_t ppid;
+    int zombies;
+    time_t since;             /* First sweep that saw it holding any */
+} zombie_holder_t;
+
+/* Zombie Counters (in the segment, so clients can show them) */
+typedef struct {
+    int zombies;              /* Zombie entries at the last sweep */
+    int holders;              /* Distinct parents holding them */
+    zombie_holder_t top[ZOMBIE_TOP_HOLDERS];  /* Parents holding the most, most first */
+    unsigned long long reaped;   /* Children of the daemon reaped */
+    time_t last_sweep;
+} zombie_stats_t;
+
+#define MANAGED_MAX 32              /* Managed children the daemon supervises at once */
+
+/* Restart Policies of managed children */
+typedef enum {
+    RESTART_NEVER,
+    RESTART_ON_FAILURE,       /* Nonzero exit status, or killed by a signal */
+    RESTART_ALWAYS
+} restart_policy_t;
+
+/* Managed Child States */
+typedef enum {
+    MANAGED_RUNNING,
+    MANAGED_BACKOFF,          /* Exited, waiting out the backoff delay */
+    MANAGED_EXITED,           /* Exited and not restarted, as the policy says */
+    MANAGED_STOPPED,          /* Stopped with `psx stop` or at shutdown */
+    MANAGED_GAVE_UP           /* Hit max_restarts within the window */
+} managed_state_t;
+
+/* A managed child (in the segment, so clients can show it) */
+typedef struct {
+    int id;                   /* 0 for a free slot */
+    pid_t pid;                /* Current process; 0 when none runs */
+    managed_state_t state;
+    restart_policy_t policy;
+    char command[64];         /* Start of the command line */
+    unsigned int restarts;
+    int last_exit;            /* Exit status, or -signal when killed */
+    double last_restart_ms;   /* Exit detected to replacement spawned, backoff included */
+    double max_restart_ms;
+    double total_restart_ms;
+} managed_stats_t;
+
+/*
+ * Process Table Header (at the start of the shared segment). Slots below
+ * count hold either a live entry or a tombstone (pid 0); a removed slot goes
+ * on the free heap and is reused by a later insert, so a process keeps its
+ * slot for its whole lifetime.
+ */
+typedef struct {
+    int count;                /* Slots in use, tombstones included */
+    int live;                 /* Live entries */
+    int free_count;           /* Entries on the free heap (validated on pop) */
+    int capacity;             /* Slots the columns are sized for */
+    int max_capacity;         /* Configured bound; sizes every mapping's reservation */
+    int index_size;           /* PID index buckets (power of two, load <= 50%) */
+    unsigned int generation;  /* Bumped on growth; clients extend their mapping */
+    size_t size;              /* Bytes of the segment in use */
+    size_t offsets[TABLE_COLUMNS];  /* Column offsets from the header */
     time_t last_sync;
     int active;
+    unsigned int seq;         /* Seqlock: odd during structural changes */
+    pthread_mutex_t lock;     /* Structural lock: count, index, slot moves, growth */
+    unsigned long long held_since_ns; /* CLOCK_MONOTONIC time the structural lock was taken */
+    table_shard_t shards[TABLE_SHARDS];
+    lock_stats_t table_lock_stats;
+    lock_stats_t shard_lock_stats;
+    scheduler_stats_t scheduler_stats;
+    zombie_stats_t zombie_stats;
+    managed_stats_t managed[MANAGED_MAX];
 } process_table_t;
 
 /* Message Types */
@@ -72,9 +238,21 @@ typedef enum {
     MSG_SHUTDOWN
 } msg_type_t;
 
+/* Process Selectors for group signals */
+typedef enum {
+    SELECT_NAME,              /* Exact process name */
+    SELECT_CMDLINE,           /* POSIX extended regex on the full command line */
+    SELECT_UID,               /* Effective uid (number or user name) */
+    SELECT_PPID,              /* Direct children of a PID */
+    SELECT_SUBTREE            /* A PID and all its descendants */
+} selector_t;
+
 /* Message Structure */
 typedef struct {
     long mtype;
+    long reply_type;          /* mtype for the response; 0 when none is wanted */
+    unsigned int request_id;  /* Echoed in the response to match it to its request */
+    int status;               /* Response: 0 on success, else an errno value */
     msg_type_t cmd;
     pid_t target_pid;
     int signal;
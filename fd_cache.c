@@ -0,0 +1,340 @@
+#include "fd_cache.h"
+#include "logger.h"
+#include <sys/resource.h>
+
+#define FD_CACHE_BUCKETS 4096       /* Hash buckets (power of two) */
+#define FD_RESERVE 256              /* Descriptors left for everything else */
+
+/* Open descriptors of one process; file fds are opened lazily */
+typedef struct fd_entry {
+    pid_t pid;
+    int dir_fd;                     /* O_PATH fd of /proc/<pid> */
+    int file_fd[PROC_FILE_COUNT];   /* -1 until first read */
+    int busy;                       /* Reads in flight outside the lock */
+    int stale;                      /* Close once the last read finishes */
+    struct fd_entry *hash_next;
+    struct fd_entry *lru_prev;      /* Most recently used at the head */
+    struct fd_entry *lru_next;
+} fd_entry_t;
+
+static const char *proc_file_names[PROC_FILE_COUNT] = {
+    "stat", "cmdline"
+};
+
+static fd_entry_t *buckets[FD_CACHE_BUCKETS];
+static fd_entry_t *lru_head = NULL;
+static fd_entry_t *lru_tail = NULL;
+static int open_fds = 0;
+static int fd_budget = 0;
+static int cached_entries = 0;
+static unsigned long proc_syscalls = 0;     /* /proc I/O syscalls issued */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/* Size the cache from RLIMIT_NOFILE, raising the soft limit to the hard one */
+static void setup_fd_budget(void) {
+    struct rlimit rl;
+    
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        if (rl.rlim_cur < rl.rlim_max) {
+            rlim_t wanted = rl.rlim_max == RLIM_INFINITY ? 1048576 : rl.rlim_max;
+            struct rlimit raised = { wanted, rl.rlim_max };
+            if (setrlimit(RLIMIT_NOFILE, &raised) == 0) {
+                rl.rlim_cur = wanted;
+            }
+        }
+        fd_budget = rl.rlim_cur > FD_RESERVE * 2 ? (int)(rl.rlim_cur / 2) : 0;
+        if (fd_budget > 1048576) fd_budget = 1048576;
+    }
+    
+    log_message("FD cache budget: %d descriptors\n", fd_budget);
+}
+
+/* Initialize FD cache */
+void init_fd_cache(void) {
+    pthread_once(&cache_once, setup_fd_budget);
+}
+
+/* Unlink an entry from the LRU list */
+static void lru_unlink(fd_entry_t *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+/* Move an entry to the head of the LRU list */
+static void lru_touch(fd_entry_t *entry) {
+    if (lru_head == entry) return;
+    if (entry->lru_prev || entry->lru_next || lru_tail == entry) {
+        lru_unlink(entry);
+    }
+    entry->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = entry;
+    lru_head = entry;
+    if (lru_tail == NULL) lru_tail = entry;
+}
+
+/* Close all descriptors of an entry and free it */
+static void close_entry(fd_entry_t *entry) {
+    for (int i = 0; i < PROC_FILE_COUNT; i++) {
+        if (entry->file_fd[i] != -1) {
+            close(entry->file_fd[i]);
+            count_proc_syscalls(1);
+            open_fds--;
+        }
+    }
+    if (entry->dir_fd != -1) {
+        close(entry->dir_fd);
+        count_proc_syscalls(1);
+        open_fds--;
+    }
+    free(entry);
+    cached_entries--;
+}
+
+/* Remove an entry from the cache; closed now or when its reads finish */
+static void detach_entry(fd_entry_t *entry) {
+    fd_entry_t **link = &buckets[entry->pid & (FD_CACHE_BUCKETS - 1)];
+    
+    while (*link != NULL && *link != entry) {
+        link = &(*link)->hash_next;
+    }
+    if (*link == entry) {
+        *link = entry->hash_next;
+    }
+    lru_unlink(entry);
+    
+    if (entry->busy > 0) {
+        entry->stale = 1;
+    } else {
+        close_entry(entry);
+    }
+}
+
+/* Evict least recently used entries until 'needed' more fds fit */
+static void make_room(int needed) {
+    fd_entry_t *entry = lru_tail;
+    
+    while (open_fds + needed > fd_budget && entry != NULL) {
+        fd_entry_t *prev = entry->lru_prev;
+        if (entry->busy == 0) {
+            detach_entry(entry);
+        }
+        entry = prev;
+    }
+}
+
+/* Find the cached entry of a PID, opening /proc/<pid> on a miss */
+static fd_entry_t* lookup_entry(pid_t pid) {
+    fd_entry_t *entry = buckets[pid & (FD_CACHE_BUCKETS - 1)];
+    char dir_path[32];
+    
+    while (entry != NULL && entry->pid != pid) {
+        entry = entry->hash_next;
+    }
+    if (entry != NULL) {
+        return entry;
+    }
+    
+    make_room(2);
+    if (open_fds + 2 > fd_budget) {
+        return NULL;
+    }
+    
+    entry = (fd_entry_t*)calloc(1, sizeof(fd_entry_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+    
+    snprintf(dir_path, sizeof(dir_path), "/proc/%d", pid);
+    entry->dir_fd = open(dir_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    count_proc_syscalls(1);
+    if (entry->dir_fd == -1) {
+        free(entry);
+        return NULL;
+    }
+    
+    entry->pid = pid;
+    for (int i = 0; i < PROC_FILE_COUNT; i++) {
+        entry->file_fd[i] = -1;
+    }
+    open_fds++;
+    cached_entries++;
+    
+    entry->hash_next = buckets[pid & (FD_CACHE_BUCKETS - 1)];
+    buckets[pid & (FD_CACHE_BUCKETS - 1)] = entry;
+    return entry;
+}
+
+/* Read a file directly, bypassing the cache */
+static ssize_t read_uncached(pid_t pid, proc_file_t file, char *buf, size_t len, off_t offset) {
+    char path[64];
+    ssize_t n;
+    int fd;
+    
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, proc_file_names[file]);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        count_proc_syscalls(1);
+        return -1;
+    }
+    n = pread(fd, buf, len, offset);
+    close(fd);
+    count_proc_syscalls(3);
+    return n;
+}
+
+/* Read a /proc/<pid> file from offset 0 through a cached descriptor */
+ssize_t read_proc_file(pid_t pid, proc_file_t file, char *buf, size_t len) {
+    return read_proc_file_at(pid, file, buf, len, 0);
+}
+
+/* Read a /proc/<pid> file at an offset through a cached descriptor */
+ssize_t read_proc_file_at(pid_t pid, proc_file_t file, char *buf, size_t len, off_t offset) {
+    fd_entry_t *entry;
+    ssize_t n;
+    int fd;
+    int fresh;
+    
+    init_fd_cache();
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        pthread_mutex_lock(&cache_lock);
+        
+        entry = fd_budget > 0 ? lookup_entry(pid) : NULL;
+        if (entry == NULL) {
+            pthread_mutex_unlock(&cache_lock);
+            return read_uncached(pid, file, buf, len, offset);
+        }
+        
+        /* Pin the entry so make_room() cannot evict it */
+        entry->busy++;
+        lru_touch(entry);
+        
+        fresh = entry->file_fd[file] == -1;
+        if (fresh) {
+            make_room(1);
+            entry->file_fd[file] = openat(entry->dir_fd, proc_file_names[file],
+                                          O_RDONLY | O_CLOEXEC);
+            count_proc_syscalls(1);
+            if (entry->file_fd[file] == -1) {
+                /* Gone (maybe reused, so retry once), or a file we cannot read */
+                entry->busy--;
+                detach_entry(entry);
+                pthread_mutex_unlock(&cache_lock);
+                continue;
+            }
+            open_fds++;
+        }
+        
+        fd = entry->file_fd[file];
+        pthread_mutex_unlock(&cache_lock);
+        
+        /* The slow part runs without the cache lock */
+        n = pread(fd, buf, len, offset);
+        count_proc_syscalls(1);
+        
+        pthread_mutex_lock(&cache_lock);
+        entry->busy--;
+        
+        if (n > 0 || (n == 0 && (file == PROC_FILE_CMDLINE || offset > 0))) {
+            if (entry->stale && entry->busy == 0) {
+                close_entry(entry);
+            }
+            pthread_mutex_unlock(&cache_lock);
+            return n;
+        }
+        
+        /*
+         * ESRCH (or an empty stat) means the process behind this fd has
+         * exited; its PID may have been reused, so retry once with fresh fds.
+         */
+        if (!entry->stale) {
+            detach_entry(entry);
+        } else if (entry->busy == 0) {
+            close_entry(entry);
+        }
+        pthread_mutex_unlock(&cache_lock);
+        
+        if (fresh) break;
+    }
+    
+    return -1;
+}
+
+/* stat() /proc/<pid> through the cached directory fd; st_uid is the process's effective uid */
+int stat_proc_dir(pid_t pid, struct stat *st) {
+    fd_entry_t *entry;
+    char path[32];
+    int rc;
+    
+    init_fd_cache();
+    
+    pthread_mutex_lock(&cache_lock);
+    
+    entry = fd_budget > 0 ? lookup_entry(pid) : NULL;
+    if (entry != NULL) {
+        rc = fstat(entry->dir_fd, st);
+        count_proc_syscalls(1);
+        pthread_mutex_unlock(&cache_lock);
+        return rc;
+    }
+    
+    pthread_mutex_unlock(&cache_lock);
+    
+    snprintf(path, sizeof(path), "/proc/%d", pid);
+    count_proc_syscalls(1);
+    return stat(path, st);
+}
+
+/* Drop the cached descriptors of an exited process */
+void evict_proc_fds(pid_t pid) {
+    fd_entry_t *entry;
+    
+    pthread_mutex_lock(&cache_lock);
+    
+    entry = buckets[pid & (FD_CACHE_BUCKETS - 1)];
+    while (entry != NULL && entry->pid != pid) {
+        entry = entry->hash_next;
+    }
+    if (entry != NULL) {
+        detach_entry(entry);
+    }
+    
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/* Number of processes with cached descriptors */
+int get_fd_cache_size(void) {
+    int count;
+    
+    pthread_mutex_lock(&cache_lock);
+    count = cached_entries;
+    pthread_mutex_unlock(&cache_lock);
+    
+    return count;
+}
+
+/* Close every cached descriptor */
+void cleanup_fd_cache(void) {
+    pthread_mutex_lock(&cache_lock);
+    
+    while (lru_head != NULL) {
+        fd_entry_t *entry = lru_head;
+        detach_entry(entry);
+    }
+    
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/* Account for /proc I/O syscalls (for psx bench) */
+void count_proc_syscalls(unsigned long n) {
+    __atomic_add_fetch(&proc_syscalls, n, __ATOMIC_RELAXED);
+}
+
+/* Total /proc I/O syscalls issued so far */
+unsigned long get_proc_syscalls(void) {
+    return __atomic_load_n(&proc_syscalls, __ATOMIC_RELAXED);
+}
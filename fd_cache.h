@@ -0,0 +1,25 @@
+#ifndef FD_CACHE_H
+#define FD_CACHE_H
+
+#include "common.h"
+#include <sys/stat.h>
+
+/* Per-process /proc files kept open between samples */
+typedef enum {
+    PROC_FILE_STAT,
+    PROC_FILE_CMDLINE,
+    PROC_FILE_COUNT
+} proc_file_t;
+
+/* FD Cache Functions */
+void init_fd_cache(void);
+void cleanup_fd_cache(void);
+ssize_t read_proc_file(pid_t pid, proc_file_t file, char *buf, size_t len);
+ssize_t read_proc_file_at(pid_t pid, proc_file_t file, char *buf, size_t len, off_t offset);
+int stat_proc_dir(pid_t pid, struct stat *st);
+void evict_proc_fds(pid_t pid);
+int get_fd_cache_size(void);
+void count_proc_syscalls(unsigned long n);
+unsigned long get_proc_syscalls(void);
+
+#endif /* FD_CACHE_H */
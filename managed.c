@@ -0,0 +1,675 @@
+#include "managed.h"
+#include "process_table.h"
+#include "proc_reader.h"
+#include "pidfd_watch.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "logger.h"
+#include "selector.h"
+#include <spawn.h>
+#include <math.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const char *policy_names[] = { "never", "on-failure", "always" };
+static const char *state_names[] = { "running", "backoff", "exited", "stopped", "gave up" };
+
+/* Daemon-side state of a managed child; stats is what the segment shows */
+typedef struct {
+    managed_stats_t stats;
+    restart_spec_t restart;
+    char args[MANAGED_ARGS_LEN];  /* NUL-separated argv, as received */
+    char *argv[MANAGED_MAX_ARGS + 1];
+    int stopping;             /* Stop requested: its exit is not restarted */
+    int quick_exits;          /* Exits in a row, each before MANAGED_STABLE_SECS of uptime */
+    double started_at;        /* CLOCK_MONOTONIC time of the last spawn */
+    double exited_at;         /* When the exit being recovered from was detected */
+    double restart_at;        /* When the backoff delay ends */
+    double history[MANAGED_RESTART_HISTORY];  /* Restart times, a ring */
+    int history_count;        /* Restarts ever; the ring holds the latest */
+} managed_child_t;
+
+static managed_child_t children[MANAGED_MAX];
+static int next_id = 1;
+static pthread_mutex_t managed_lock = PTHREAD_MUTEX_INITIALIZER;
+static int server_fd = -1;
+static int server_wake_fd = -1;
+static int server_running = 0;
+static pthread_t server_tid;
+
+static double monotonic_now(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Show a child's current state to clients (caller holds managed_lock) */
+static void publish_child(const managed_child_t *child) {
+    process_table_t *table = attach_shared_memory();
+    
+    if (table != NULL) {
+        table->managed[child - children] = child->stats;
+    }
+}
+
+/*
+ * Start the child's command with posix_spawnp(), which clones with vfork
+ * semantics: no copy of the daemon's page tables, and the call returns
+ * once the exec has succeeded or failed. The child gets an empty signal
+ * mask (the daemon blocks SIGINT, SIGTERM and SIGCHLD), its own process
+ * group so a terminal's ^C meant for the daemon misses it, stdin from
+ * /dev/null, and none of the daemon's descriptors past stderr.
+ * Returns 0 or an errno value (caller holds managed_lock).
+ */
+static int spawn_child(managed_child_t *child) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t none;
+    pid_t pid;
+    int rc;
+    
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+    
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+    
+    rc = posix_spawnp(&pid, child->argv[0], &actions, &attr, child->argv, environ);
+    
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    
+    child->stats.pid = rc == 0 ? pid : 0;
+    return rc;
+}
+
+/* Enter a freshly spawned child in the table at once, as a fork event would */
+static void track_child(const managed_child_t *child) {
+    process_table_t *table = attach_shared_memory();
+    system_snapshot_t sys;
+    process_info_t info;
+    
+    if (table == NULL || read_system_snapshot(&sys) != 0) {
+        return;
+    }
+    if (sample_process(child->stats.pid, &sys, &info) == 0 && upsert_process(table, &info) >= 0) {
+        watch_process(&info);
+        scheduler_track(&info);
+    }
+}
+
+/* Whether the window has room for another restart */
+static int restart_allowed(const managed_child_t *child, double now) {
+    int max = child->restart.max_restarts;
+    
+    if (max <= 0 || child->history_count < max) {
+        return 1;
+    }
+    /* The max-th latest restart must have left the window */
+    return now - child->history[(child->history_count - max) % MANAGED_RESTART_HISTORY] >=
+           child->restart.window_secs;
+}
+
+/*
+ * Decide when an exited child comes back: at once after the first quick
+ * exit in a row, then after backoff_ms, doubling with each further quick
+ * exit up to MANAGED_BACKOFF_MAX_MS. Gives up when the window already
+ * holds max_restarts restarts (caller holds managed_lock).
+ */
+static void schedule_restart(managed_child_t *child, double now) {
+    double delay_ms = 0;
+    char result[96];
+    
+    child->quick_exits++;
+    
+    if (!restart_allowed(child, now)) {
+        child->stats.state = MANAGED_GAVE_UP;
+        snprintf(result, sizeof(result), "Managed child %d gave up: %d restarts within %d s",
+                 child->stats.id, child->restart.max_restarts, child->restart.window_secs);
+        log_operation("MANAGED_GAVE_UP", 0, result);
+        return;
+    }
+    
+    if (child->quick_exits > 1) {
+        delay_ms = child->restart.backoff_ms;
+        for (int i = 2; i < child->quick_exits && delay_ms < MANAGED_BACKOFF_MAX_MS; i++) {
+            delay_ms *= 2;
+        }
+        if (delay_ms > MANAGED_BACKOFF_MAX_MS) {
+            delay_ms = MANAGED_BACKOFF_MAX_MS;
+        }
+    }
+    
+    child->stats.state = MANAGED_BACKOFF;
+    child->restart_at = now + delay_ms / 1000.0;
+}
+
+/*
+ * Spawn the replacement of an exited child and record how long it was
+ * down, from the exit being detected to the new process running. A failed
+ * spawn counts as another quick exit (caller holds managed_lock).
+ */
+static void restart_child(managed_child_t *child) {
+    double now = monotonic_now();
+    char result[128];
+    int rc;
+    
+    child->history[child->history_count % MANAGED_RESTART_HISTORY] = now;
+    child->history_count++;
+    
+    rc = spawn_child(child);
+    now = monotonic_now();
+    
+    if (rc != 0) {
+        snprintf(result, sizeof(result), "Failed to restart managed child %d: %s",
+                 child->stats.id, strerror(rc));
+        log_operation("MANAGED_RESTART", 0, result);
+        schedule_restart(child, now);
+        return;
+    }
+    
+    double latency_ms = (now - child->exited_at) * 1000.0;
+    child->stats.state = MANAGED_RUNNING;
+    child->stats.restarts++;
+    child->stats.last_restart_ms = latency_ms;
+    child->stats.total_restart_ms += latency_ms;
+    if (latency_ms > child->stats.max_restart_ms) {
+        child->stats.max_restart_ms = latency_ms;
+    }
+    child->started_at = now;
+    
+    snprintf(result, sizeof(result), "Restarted managed child %d after %.2f ms",
+             child->stats.id, latency_ms);
+    log_operation("MANAGED_RESTART", child->stats.pid, result);
+    track_child(child);
+}
+
+/*
+ * Launch the command of a run request as a managed child, restarted on
+ * exit as its restart spec says. Returns 0 or an errno value, with a
+ * message in response.
+ */
+int launch_managed(const managed_request_t *request, char *response, size_t response_len) {
+    restart_spec_t spec = request->restart;
+    managed_child_t *child = NULL;
+    int argc = 0;
+    int rc;
+    
+    if (spec.policy < RESTART_NEVER || spec.policy > RESTART_ALWAYS ||
+        spec.max_restarts < 0 || spec.max_restarts > MANAGED_RESTART_HISTORY ||
+        (spec.max_restarts > 0 && spec.window_secs <= 0) ||
+        spec.backoff_ms < 1 || spec.backoff_ms > MANAGED_BACKOFF_MAX_MS) {
+        snprintf(response, response_len, "Error: Invalid restart policy (max %d restarts, backoff 1-%d ms)",
+                 MANAGED_RESTART_HISTORY, MANAGED_BACKOFF_MAX_MS);
+        return EINVAL;
+    }
+    
+    pthread_mutex_lock(&managed_lock);
+    
+    /* A free slot, else the first child that is done for good */
+    for (int i = 0; i < MANAGED_MAX && child == NULL; i++) {
+        if (children[i].stats.id == 0) child = &children[i];
+    }
+    for (int i = 0; i < MANAGED_MAX && child == NULL; i++) {
+        if (children[i].stats.state >= MANAGED_EXITED) child = &children[i];
+    }
+    if (child == NULL) {
+        pthread_mutex_unlock(&managed_lock);
+        snprintf(response, response_len, "Error: All %d managed children are running", MANAGED_MAX);
+        return EAGAIN;
+    }
+    
+    memset(child, 0, sizeof(*child));
+    memcpy(child->args, request->argument, sizeof(child->args));
+    child->args[sizeof(child->args) - 2] = '\0';
+    child->args[sizeof(child->args) - 1] = '\0';
+    
+    /* Every string ends by the next to last byte, so the walk stops on the last */
+    for (char *arg = child->args; *arg != '\0'; arg += strlen(arg) + 1) {
+        if (argc == MANAGED_MAX_ARGS) {
+            argc = -1;
+            break;
+        }
+        child->argv[argc++] = arg;
+    }
+    if (argc <= 0) {
+        memset(child, 0, sizeof(*child));
+        publish_child(child);
+        pthread_mutex_unlock(&managed_lock);
+        snprintf(response, response_len, argc == 0 ? "Error: Command required" :
+                 "Error: More than %d arguments", MANAGED_MAX_ARGS);
+        return argc == 0 ? EINVAL : E2BIG;
+    }
+    
+    for (int i = 0; i < argc; i++) {
+        size_t used = strlen(child->stats.command);
+        snprintf(child->stats.command + used, sizeof(child->stats.command) - used,
+                 "%s%s", i > 0 ? " " : "", child->argv[i]);
+    }
+    
+    rc = spawn_child(child);
+    if (rc != 0) {
+        snprintf(response, response_len, "Error: Failed to start %s: %s", child->argv[0], strerror(rc));
+        memset(child, 0, sizeof(*child));
+        publish_child(child);
+        pthread_mutex_unlock(&managed_lock);
+        return rc;
+    }
+    
+    child->restart = spec;
+    child->started_at = monotonic_now();
+    child->stats.id = next_id++;
+    child->stats.state = MANAGED_RUNNING;
+    child->stats.policy = spec.policy;
+    publish_child(child);
+    
+    snprintf(response, response_len, "Success: Started managed child %d (PID %d), restart %s",
+             child->stats.id, child->stats.pid, policy_names[spec.policy]);
+    log_operation("MANAGED_START", child->stats.pid, response);
+    track_child(child);
+    
+    pthread_mutex_unlock(&managed_lock);
+    return 0;
+}
+
+/*
+ * Stop a managed child for good: SIGTERM to its process, or no restart
+ * when it is waiting out a backoff. Returns 0 or an errno value.
+ */
+int stop_managed(int id, char *response, size_t response_len) {
+    managed_child_t *child = NULL;
+    int rc = 0;
+    
+    pthread_mutex_lock(&managed_lock);
+    
+    for (int i = 0; i < MANAGED_MAX && child == NULL; i++) {
+        if (id > 0 && children[i].stats.id == id) child = &children[i];
+    }
+    
+    if (child == NULL) {
+        rc = ESRCH;
+        snprintf(response, response_len, "Error: No managed child %d", id);
+    } else if (child->stats.state == MANAGED_RUNNING) {
+        /* The daemon reaps its own children, so the PID is not reused before the exit is handled */
+        child->stopping = 1;
+        rc = kill(child->stats.pid, SIGTERM) == 0 ? 0 : errno;
+        if (rc == 0) {
+            snprintf(response, response_len, "Success: Stopping managed child %d (PID %d)", id, child->stats.pid);
+        } else {
+            snprintf(response, response_len, "Error: Failed to stop managed child %d: %s", id, strerror(rc));
+        }
+        log_operation("MANAGED_STOP", child->stats.pid, response);
+    } else if (child->stats.state == MANAGED_BACKOFF) {
+        child->stats.state = MANAGED_STOPPED;
+        publish_child(child);
+        snprintf(response, response_len, "Success: Managed child %d stopped", id);
+        log_operation("MANAGED_STOP", 0, response);
+    } else {
+        snprintf(response, response_len, "Success: Managed child %d is not running (%s)",
+                 id, state_names[child->stats.state]);
+    }
+    
+    pthread_mutex_unlock(&managed_lock);
+    return rc;
+}
+
+/* Stop every managed child (daemon shutdown) */
+void stop_all_managed(void) {
+    pthread_mutex_lock(&managed_lock);
+    
+    for (int i = 0; i < MANAGED_MAX; i++) {
+        managed_child_t *child = &children[i];
+        
+        if (child->stats.id == 0) continue;
+        if (child->stats.state == MANAGED_RUNNING) {
+            child->stopping = 1;
+            kill(child->stats.pid, SIGTERM);
+        } else if (child->stats.state == MANAGED_BACKOFF) {
+            child->stats.state = MANAGED_STOPPED;
+            publish_child(child);
+        }
+    }
+    
+    pthread_mutex_unlock(&managed_lock);
+}
+
+/*
+ * Handle the exit of a reaped child of the daemon. A managed one is
+ * restarted as its policy says, right here when no backoff applies, so
+ * the replacement runs within the same SIGCHLD wakeup. Returns whether
+ * the PID was a managed child.
+ */
+int handle_managed_exit(pid_t pid, const siginfo_t *info) {
+    managed_child_t *child = NULL;
+    double now = monotonic_now();
+    int failed;
+    
+    pthread_mutex_lock(&managed_lock);
+    
+    for (int i = 0; i < MANAGED_MAX && child == NULL; i++) {
+        if (children[i].stats.id != 0 && children[i].stats.pid == pid) child = &children[i];
+    }
+    if (child == NULL) {
+        pthread_mutex_unlock(&managed_lock);
+        return 0;
+    }
+    
+    child->stats.pid = 0;
+    child->stats.last_exit = info->si_code == CLD_EXITED ? info->si_status : -info->si_status;
+    child->exited_at = now;
+    failed = info->si_code != CLD_EXITED || info->si_status != 0;
+    
+    if (now - child->started_at >= MANAGED_STABLE_SECS) {
+        child->quick_exits = 0;
+    }
+    
+    if (child->stopping) {
+        child->stats.state = MANAGED_STOPPED;
+    } else if (child->restart.policy == RESTART_NEVER ||
+               (child->restart.policy == RESTART_ON_FAILURE && !failed)) {
+        child->stats.state = MANAGED_EXITED;
+    } else {
+        schedule_restart(child, now);
+        if (child->stats.state == MANAGED_BACKOFF && child->restart_at <= now) {
+            restart_child(child);
+        }
+    }
+    publish_child(child);
+    
+    pthread_mutex_unlock(&managed_lock);
+    return 1;
+}
+
+/* Milliseconds until the next backoff delay ends; -1 when none is pending */
+int next_managed_restart_ms(void) {
+    double now = monotonic_now();
+    int next = -1;
+    
+    pthread_mutex_lock(&managed_lock);
+    for (int i = 0; i < MANAGED_MAX; i++) {
+        if (children[i].stats.id == 0 || children[i].stats.state != MANAGED_BACKOFF) continue;
+        
+        double wait_ms = ceil((children[i].restart_at - now) * 1000.0);
+        int ms = wait_ms > 0 ? (int)wait_ms : 0;
+        if (next < 0 || ms < next) next = ms;
+    }
+    pthread_mutex_unlock(&managed_lock);
+    
+    return next;
+}
+
+/* Restart the children whose backoff delay has ended */
+void restart_managed_due(void) {
+    double now = monotonic_now();
+    
+    pthread_mutex_lock(&managed_lock);
+    for (int i = 0; i < MANAGED_MAX; i++) {
+        managed_child_t *child = &children[i];
+        
+        if (child->stats.id == 0 || child->stats.state != MANAGED_BACKOFF || child->restart_at > now) {
+            continue;
+        }
+        restart_child(child);
+        publish_child(child);
+    }
+    pthread_mutex_unlock(&managed_lock);
+}
+
+/* Parse a restart policy word; -1 if unknown */
+int parse_restart_policy(const char *word, restart_policy_t *policy) {
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(word, policy_names[i]) == 0) {
+            *policy = (restart_policy_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* restart_policy_name(restart_policy_t policy) {
+    return policy >= RESTART_NEVER && policy <= RESTART_ALWAYS ? policy_names[policy] : "?";
+}
+
+const char* managed_state_name(managed_state_t state) {
+    return state >= MANAGED_RUNNING && state <= MANAGED_GAVE_UP ? state_names[state] : "?";
+}
+
+/* Address of the control socket in the abstract namespace; returns its length */
+static socklen_t control_address(struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    /* The leading NUL keeps it off the filesystem: nothing to unlink or chmod */
+    memcpy(addr->sun_path + 1, MANAGED_SOCKET_NAME, strlen(MANAGED_SOCKET_NAME));
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(MANAGED_SOCKET_NAME));
+}
+
+/* Send one per-PID result of a group signal; nonzero once the client stops reading */
+static int send_signal_result(pid_t pid, int status, const char *result, void *ctx) {
+    int fd = *(const int*)ctx;
+    managed_reply_t reply;
+    
+    memset(&reply, 0, sizeof(reply));
+    reply.status = status;
+    reply.more = 1;
+    reply.pid = pid;
+    snprintf(reply.response, sizeof(reply.response), "%s", result);
+    return send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) == (ssize_t)sizeof(reply) ? 0 : -1;
+}
+
+/*
+ * Answer one connection. The caller's uid comes from SO_PEERCRED, which
+ * the kernel fills in at connect time. Only the daemon's own uid may run
+ * or stop children: anything else could start commands as that uid. Any
+ * uid may send a group signal, which reaches only the processes it could
+ * signal itself.
+ */
+static void serve_client(int fd) {
+    managed_request_t request;
+    managed_reply_t reply;
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    struct timeval timeout = { 1, 0 };
+    
+    memset(&reply, 0, sizeof(reply));
+    memset(&cred, 0, sizeof(cred));
+    
+    /* A client that connects and then stalls cannot hold up the thread */
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    /* Read the request even when refusing it, so the client gets the reply */
+    if (recv(fd, &request, sizeof(request), 0) != (ssize_t)sizeof(request)) {
+        reply.status = EINVAL;
+        strcpy(reply.response, "Error: Malformed request");
+    } else if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+        reply.status = EPERM;
+        strcpy(reply.response, "Error: Caller credentials unavailable");
+    } else if (request.cmd == MANAGED_CMD_SIGNAL) {
+        group_signal_t group;
+        
+        request.argument[sizeof(request.argument) - 1] = '\0';
+        group.selector = request.selector;
+        group.argument = request.argument;
+        group.signal = request.signal;
+        group.freeze = request.freeze;
+        group.caller_uid = cred.uid;
+        group.caller_pid = cred.pid;
+        reply.status = signal_selected(&group, send_signal_result, &fd, reply.response, sizeof(reply.response));
+    } else if (cred.uid != geteuid()) {
+        char result[96];
+        reply.status = EPERM;
+        snprintf(reply.response, sizeof(reply.response),
+                 "Error: Only uid %d may run or stop managed children", (int)geteuid());
+        snprintf(result, sizeof(result), "Refused request from uid %d", (int)cred.uid);
+        log_operation("MANAGED_DENIED", cred.pid, result);
+    } else if (request.cmd == MANAGED_CMD_RUN) {
+        reply.status = launch_managed(&request, reply.response, sizeof(reply.response));
+    } else if (request.cmd == MANAGED_CMD_STOP) {
+        reply.status = stop_managed(request.id, reply.response, sizeof(reply.response));
+    } else {
+        reply.status = EINVAL;
+        strcpy(reply.response, "Error: Unknown command");
+    }
+    
+    send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+/* Control socket thread: one request per connection, until stop_managed_server() */
+static void* managed_server_thread(void *arg) {
+    struct pollfd pfds[2] = { { server_fd, POLLIN, 0 }, { server_wake_fd, POLLIN, 0 } };
+    (void)arg;
+    
+    log_message("Managed control socket listening\n");
+    
+    for (;;) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            log_message("Managed control socket poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (pfds[1].revents != 0) {
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd != -1) {
+                serve_client(fd);
+                close(fd);
+            }
+        }
+    }
+    
+    log_message("Managed control socket closed\n");
+    return NULL;
+}
+
+/* Listen for run and stop requests; -1 if the socket cannot be set up */
+int start_managed_server(void) {
+    struct sockaddr_un addr;
+    socklen_t addr_len = control_address(&addr);
+    
+    if (server_running) {
+        return 0;
+    }
+    
+    server_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (server_fd == -1 || bind(server_fd, (struct sockaddr*)&addr, addr_len) != 0 ||
+        listen(server_fd, 8) != 0) {
+        log_message("Managed control socket unavailable: %s\n", strerror(errno));
+        if (server_fd != -1) close(server_fd);
+        server_fd = -1;
+        return -1;
+    }
+    
+    server_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (server_wake_fd == -1) {
+        log_message("Managed control socket unavailable: eventfd: %s\n", strerror(errno));
+        close(server_fd);
+        server_fd = -1;
+        return -1;
+    }
+    
+    server_running = 1;
+    if (pthread_create(&server_tid, NULL, managed_server_thread, NULL) != 0) {
+        perror("pthread_create managed server");
+        server_running = 0;
+        close(server_wake_fd);
+        close(server_fd);
+        server_wake_fd = server_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Stop taking requests and close the socket */
+void stop_managed_server(void) {
+    uint64_t one = 1;
+    
+    if (!server_running) {
+        return;
+    }
+    
+    if (write(server_wake_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+        log_message("Managed control socket wake-up failed: %s\n", strerror(errno));
+    }
+    pthread_join(server_tid, NULL);
+    server_running = 0;
+    
+    close(server_wake_fd);
+    close(server_fd);
+    server_wake_fd = server_fd = -1;
+}
+
+/*
+ * Send one request to the daemon's control socket and wait up to
+ * timeout_ms for each reply. Intermediate replies (more set) go to
+ * on_reply, if given; the final one is left in reply. Returns 0 when the
+ * request succeeded, else -1 with reply->status and reply->response set.
+ */
+int managed_call(const managed_request_t *request, managed_reply_t *reply, int timeout_ms,
+                 managed_reply_fn on_reply, void *ctx) {
+    struct sockaddr_un addr;
+    socklen_t addr_len = control_address(&addr);
+    struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    int fd;
+    
+    memset(reply, 0, sizeof(*reply));
+    
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, addr_len) != 0) {
+        reply->status = errno;
+        snprintf(reply->response, sizeof(reply->response),
+                 "Error: Daemon control socket unavailable: %s", strerror(reply->status));
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    
+    /* Any process may bind an abstract name first: trust only root or our own uid */
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 ||
+        (cred.uid != 0 && cred.uid != geteuid())) {
+        reply->status = EPERM;
+        snprintf(reply->response, sizeof(reply->response),
+                 "Error: Control socket is not held by root or uid %d", (int)geteuid());
+        close(fd);
+        return -1;
+    }
+    
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    if (send(fd, request, sizeof(*request), MSG_NOSIGNAL) != (ssize_t)sizeof(*request)) {
+        reply->status = errno == EAGAIN ? ETIMEDOUT : errno;
+        snprintf(reply->response, sizeof(reply->response),
+                 "Error: Failed to send request: %s", strerror(reply->status));
+    } else {
+        /* Intermediate replies first, each within timeout_ms of the previous one */
+        while (recv(fd, reply, sizeof(*reply), 0) == (ssize_t)sizeof(*reply) && reply->more) {
+            reply->response[sizeof(reply->response) - 1] = '\0';
+            if (on_reply != NULL) {
+                on_reply(reply, ctx);
+            }
+        }
+        if (reply->more || reply->response[0] == '\0') {
+            reply->status = errno == EAGAIN ? ETIMEDOUT : EPROTO;
+            reply->more = 0;
+            snprintf(reply->response, sizeof(reply->response),
+                     "Error: No reply from daemon: %s", strerror(reply->status));
+        }
+    }
+    reply->response[sizeof(reply->response) - 1] = '\0';
+    
+    close(fd);
+    return reply->status == 0 ? 0 : -1;
+}
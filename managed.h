@@ -0,0 +1,72 @@
+#ifndef MANAGED_H
+#define MANAGED_H
+
+#include "common.h"
+
+#define MANAGED_DEFAULT_MAX_RESTARTS 10  /* Restarts allowed per window unless told otherwise */
+#define MANAGED_DEFAULT_WINDOW_SECS 60
+#define MANAGED_DEFAULT_BACKOFF_MS 100
+#define MANAGED_BACKOFF_MAX_MS 30000     /* Longest delay between restarts */
+#define MANAGED_STABLE_SECS 10           /* Uptime after which a crash restarts at once again */
+#define MANAGED_RESTART_HISTORY 64       /* Restart times kept per child (caps max_restarts) */
+#define MANAGED_MAX_ARGS 32
+#define MANAGED_ARGS_LEN 1024            /* Bytes of NUL-separated argv a run request carries */
+#define MANAGED_SOCKET_NAME "psx_managed"  /* Abstract Unix socket taking run, stop and signal */
+
+/* How a managed child is restarted */
+typedef struct {
+    restart_policy_t policy;
+    int max_restarts;         /* Restarts allowed within window_secs; 0 for no limit */
+    int window_secs;
+    int backoff_ms;           /* Delay before the second quick restart in a row; doubles after */
+} restart_spec_t;
+
+/* Control Socket Commands */
+typedef enum {
+    MANAGED_CMD_RUN,
+    MANAGED_CMD_STOP,
+    MANAGED_CMD_SIGNAL        /* Signal every process a selector matches */
+} managed_cmd_t;
+
+/*
+ * Control socket request. Run, stop and group signals start or kill
+ * processes as the daemon's uid, so they never travel on the
+ * world-writable message queue: the socket tells who is asking.
+ */
+typedef struct {
+    managed_cmd_t cmd;
+    int id;                   /* MANAGED_CMD_STOP: the managed child */
+    restart_spec_t restart;   /* MANAGED_CMD_RUN: when to restart the child */
+    selector_t selector;      /* MANAGED_CMD_SIGNAL: how argument picks processes */
+    int signal;               /* MANAGED_CMD_SIGNAL */
+    int freeze;               /* MANAGED_CMD_SIGNAL on a subtree: SIGSTOP it top-down first */
+    char argument[MANAGED_ARGS_LEN];  /* RUN: NUL-separated argv, ended by an empty word; SIGNAL: name, pattern or number */
+} managed_request_t;
+
+/* Control socket reply */
+typedef struct {
+    int status;               /* 0 on success, else an errno value */
+    int more;                 /* Further replies to this request follow (per-PID results) */
+    pid_t pid;                /* The process an intermediate reply is about */
+    char response[256];
+} managed_reply_t;
+
+/* Called for each intermediate reply (more set) */
+typedef void (*managed_reply_fn)(const managed_reply_t *reply, void *ctx);
+
+/* Managed Child Functions */
+int start_managed_server(void);
+void stop_managed_server(void);
+int managed_call(const managed_request_t *request, managed_reply_t *reply, int timeout_ms,
+                 managed_reply_fn on_reply, void *ctx);
+int launch_managed(const managed_request_t *request, char *response, size_t response_len);
+int stop_managed(int id, char *response, size_t response_len);
+void stop_all_managed(void);
+int handle_managed_exit(pid_t pid, const siginfo_t *info);
+int next_managed_restart_ms(void);
+void restart_managed_due(void);
+int parse_restart_policy(const char *word, restart_policy_t *policy);
+const char* restart_policy_name(restart_policy_t policy);
+const char* managed_state_name(managed_state_t state);
+
+#endif /* MANAGED_H */
@@ -1,6 +1,24 @@
 #include "message_queue.h"
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <poll.h>
 
 static int msg_queue_id = -1;
+static unsigned int next_request_id = 0;
+static volatile sig_atomic_t rpc_timed_out = 0;
+
+/* A client the server has replied to */
+typedef struct {
+    long type;                /* Reply type; 0 for a free slot */
+    int pidfd;                /* Pins the client process; -1 without pidfds */
+    int dropped;              /* A reply was dropped and none delivered since */
+} rpc_client_t;
+
+/* Server side (command server thread only) */
+static rpc_client_t clients[RPC_TRACKED_CLIENTS];
+static int clients_next = 0;
+
+static void release_client(rpc_client_t *client);
 
 /* Initialize message queue */
 int init_message_queue(void) {
@@ -16,6 +34,9 @@ int init_message_queue(void) {
 
 /* Destroy message queue */
 void destroy_message_queue(void) {
+    for (int i = 0; i < RPC_TRACKED_CLIENTS; i++) {
+        release_client(&clients[i]);
+    }
     if (msg_queue_id != -1) {
         msgctl(msg_queue_id, IPC_RMID, NULL);
         msg_queue_id = -1;
@@ -32,7 +53,9 @@ int send_command(msg_type_t cmd, pid_t pid, int signal) {
     }
     
     process_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
     msg.mtype = 1;  /* Server message type */
+    msg.reply_type = 0;
     msg.cmd = cmd;
     msg.target_pid = pid;
     msg.signal = signal;
@@ -47,7 +70,10 @@ int send_command(msg_type_t cmd, pid_t pid, int signal) {
     return 0;
 }
 
-/* Receive command from message queue */
+/*
+ * Receive a command, blocking until one arrives (no polling). Returns -1
+ * only if the queue is gone or unusable.
+ */
 int receive_command(process_msg_t *msg) {
     if (msg_queue_id == -1) {
         if (init_message_queue() == -1) {
@@ -55,32 +81,325 @@ int receive_command(process_msg_t *msg) {
         }
     }
     
-    if (msgrcv(msg_queue_id, msg, sizeof(*msg) - sizeof(long), 1, IPC_NOWAIT) == -1) {
-        if (errno != ENOMSG) {
+    while (msgrcv(msg_queue_id, msg, sizeof(*msg) - sizeof(long), 1, 0) == -1) {
+        if (errno != EINTR) {
             perror("msgrcv");
+            return -1;
         }
-        return -1;
     }
     
     return 0;
 }
 
-/* Send response */
-int send_response(long mtype, const char *response) {
+/* Forget a tracked client */
+static void release_client(rpc_client_t *client) {
+    if (client->type != 0 && client->pidfd != -1) {
+        close(client->pidfd);
+    }
+    client->type = 0;
+}
+
+/*
+ * Whether a tracked client has exited. Its pidfd keeps answering for the
+ * process the server first replied to, even once the PID is reused;
+ * without pidfds this falls back to kill(pid, 0).
+ */
+static int client_gone(const rpc_client_t *client) {
+    if (client->pidfd != -1) {
+        struct pollfd pfd = { client->pidfd, POLLIN, 0 };
+        return poll(&pfd, 1, 0) > 0;
+    }
+    return kill((pid_t)(client->type - 1), 0) == -1 && errno == ESRCH;
+}
+
+/*
+ * The tracked client a reply type belongs to. A new client is tracked
+ * when it is first replied to, replacing an entry whose process exited
+ * (the PID was reused) or else the oldest one.
+ */
+static rpc_client_t* track_client(long type) {
+    rpc_client_t *client = NULL;
+    
+    for (int i = 0; i < RPC_TRACKED_CLIENTS; i++) {
+        if (clients[i].type == type) {
+            if (!client_gone(&clients[i])) return &clients[i];
+            client = &clients[i];
+            break;
+        }
+    }
+    if (client == NULL) {
+        client = &clients[clients_next];
+        clients_next = (clients_next + 1) % RPC_TRACKED_CLIENTS;
+    }
+    
+    release_client(client);
+    client->type = type;
+    client->pidfd = (int)syscall(SYS_pidfd_open, (pid_t)(type - 1), 0);
+    client->dropped = 0;
+    return client;
+}
+
+/*
+ * Discard the replies of tracked clients that have exited (timed out and
+ * gone, or killed), which no one will read. Only those clients' reply
+ * types are taken off the queue; a live client's replies are never
+ * touched. Returns how many replies were discarded.
+ */
+static int discard_orphaned_replies(void) {
+    process_msg_t msg;
+    int discarded = 0;
+    
+    for (int i = 0; i < RPC_TRACKED_CLIENTS; i++) {
+        if (clients[i].type == 0 || !client_gone(&clients[i])) continue;
+        
+        int count = 0;
+        while (msgrcv(msg_queue_id, &msg, sizeof(msg) - sizeof(long), clients[i].type, IPC_NOWAIT) != -1) {
+            count++;
+        }
+        if (count > 0) {
+            log_message("Discarded %d replies to exited client %ld\n", count, clients[i].type - 1);
+        }
+        discarded += count;
+        release_client(&clients[i]);
+    }
+    return discarded;
+}
+
+/*
+ * Count the messages of a type on the queue in place (MSG_COPY), without
+ * taking any off. Returns -1 if the kernel cannot copy messages.
+ */
+static int queued_messages(long type) {
+    process_msg_t msg;
+    int count = 0;
+    
+    for (long i = 0; msgrcv(msg_queue_id, &msg, sizeof(msg) - sizeof(long), i, IPC_NOWAIT | MSG_COPY) != -1; i++) {
+        if (msg.mtype == type) count++;
+    }
+    return errno == ENOMSG ? count : -1;
+}
+
+/*
+ * Whether a reply of a type may go on the queue. Replies leave
+ * RPC_REQUEST_HEADROOM messages of room, so requests (the daemon's
+ * shutdown included) still fit and the server can always be reached.
+ * Once the queue is half full, one client may hold at most
+ * RPC_CLIENT_REPLIES unread replies, so a client that stopped reading
+ * cannot take the room other clients' replies need. Sets errno to EAGAIN
+ * when there is no room.
+ */
+static int reply_room(long type) {
+    struct msqid_ds ds;
+    
+    if (msgctl(msg_queue_id, IPC_STAT, &ds) != 0) {
+        return 0;
+    }
+    
+    unsigned long slots = ds.msg_qbytes / sizeof(process_msg_t);
+    if (ds.msg_qnum + RPC_REQUEST_HEADROOM + 1 > slots ||
+        (ds.msg_qnum * 2 >= slots && queued_messages(type) >= RPC_CLIENT_REPLIES)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Send the response to a request on the message type it asked for, echoing
+ * its request ID. Never sent on the server's own type. When the
+ * queue is short of room, the replies of exited clients are discarded
+ * first; then the reply is retried for up to 100 ms, so a client that
+ * stopped listening cannot stall the server. Once a client's reply has
+ * been dropped, its replies get one attempt each until one goes through.
+ */
+int send_response(const process_msg_t *request, int status, const char *response) {
     if (msg_queue_id == -1) {
         return -1;
     }
+    if (request->reply_type <= 1) {
+        return 0;
+    }
     
     process_msg_t msg;
-    msg.mtype = mtype;
+    memset(&msg, 0, sizeof(msg));
+    msg.mtype = request->reply_type;
+    msg.request_id = request->request_id;
+    msg.status = status;
+    msg.cmd = request->cmd;
+    msg.target_pid = request->target_pid;
     strncpy(msg.response, response, sizeof(msg.response) - 1);
     msg.response[sizeof(msg.response) - 1] = '\0';
     
-    if (msgsnd(msg_queue_id, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
-        perror("msgsnd response");
-        return -1;
+    rpc_client_t *client = track_client(msg.mtype);
+    if (client_gone(client)) {
+        return -1;  /* No one would read it */
     }
     
+    for (int tries = 0; reply_room(msg.mtype) == -1 ||
+         msgsnd(msg_queue_id, &msg, sizeof(msg) - sizeof(long), IPC_NOWAIT) == -1; tries++) {
+        int err = errno;
+        
+        if (err == EAGAIN && tries == 0 && discard_orphaned_replies() > 0) {
+            continue;
+        }
+        if (err != EAGAIN || client->dropped || tries >= 100 || client_gone(client)) {
+            log_message("Dropped response to request %u: %s\n", request->request_id, strerror(err));
+            client->dropped = 1;
+            return -1;
+        }
+        usleep(1000);
+    }
+    
+    client->dropped = 0;
+    return 0;
+}
+
+/* Reply type of this client: its PID + 1, never the server's type 1 */
+static long client_reply_type(void) {
+    return (long)getpid() + 1;
+}
+
+/* SIGALRM handler: ends the current wait for a reply */
+static void rpc_alarm(int sig) {
+    (void)sig;
+    rpc_timed_out = 1;
+}
+
+/* Arm the reply timer: fires after timeout_ms, then every 10 ms until disarmed */
+static void arm_reply_timer(int timeout_ms) {
+    struct itimerval timer;
+    
+    rpc_timed_out = 0;
+    timer.it_value.tv_sec = timeout_ms / 1000;
+    timer.it_value.tv_usec = (timeout_ms % 1000) * 1000;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 10000;
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) {
+        timer.it_value.tv_usec = 1000;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/*
+ * Wait in a blocking msgrcv for a reply to this client. The reply timer
+ * interrupts it (no SA_RESTART); repeating, it also catches a signal that
+ * fired just before the call. Returns -1 on timeout or error.
+ */
+static int receive_reply(process_msg_t *reply) {
+    while (msgrcv(msg_queue_id, reply, sizeof(*reply) - sizeof(long), client_reply_type(), 0) == -1) {
+        if (errno != EINTR || rpc_timed_out) {
+            return -1;
+        }
+    }
     return 0;
 }
 
+/*
+ * Send a batch of requests and collect their replies, pipelined: up to
+ * RPC_WINDOW requests are in flight at once, so N commands cost about one
+ * round trip plus N server handling times instead of N round trips, while
+ * requests and replies in flight stay well below the queue's byte limit.
+ * Replies come back on this client's own message type and are matched by
+ * request ID, so late replies to an earlier batch are ignored. Each
+ * request's status and response are filled in; requests that got no reply
+ * within timeout_ms of the previous one get ETIMEDOUT. Returns the number
+ * of requests answered (replied to or failed to send), or -1 if the queue
+ * is unavailable.
+ */
+int rpc_pipeline(rpc_request_t *requests, int count, int timeout_ms) {
+    struct sigaction action, old_action;
+    struct itimerval disarm;
+    process_msg_t msg;
+    unsigned int base;
+    int sent = 0, in_flight = 0, answered = 0;
+    
+    if (requests == NULL || count <= 0) return 0;
+    if (msg_queue_id == -1 && init_message_queue() == -1) {
+        return -1;
+    }
+    
+    if (next_request_id == 0) {
+        next_request_id = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16);
+    }
+    base = next_request_id;
+    next_request_id += (unsigned int)count;
+    
+    for (int i = 0; i < count; i++) {
+        requests[i].status = ETIMEDOUT;
+        requests[i].response[0] = '\0';
+    }
+    
+    /* Replies left over from an earlier client with this PID */
+    while (msgrcv(msg_queue_id, &msg, sizeof(msg) - sizeof(long), client_reply_type(), IPC_NOWAIT) != -1) {
+    }
+    
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = rpc_alarm;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, &old_action);
+    
+    while (answered < count) {
+        arm_reply_timer(timeout_ms);
+        
+        /* Fill the window */
+        while (sent < count && in_flight < RPC_WINDOW) {
+            memset(&msg, 0, sizeof(msg));
+            msg.mtype = 1;
+            msg.reply_type = client_reply_type();
+            msg.request_id = base + (unsigned int)sent;
+            msg.cmd = requests[sent].cmd;
+            msg.target_pid = requests[sent].target_pid;
+            msg.signal = requests[sent].signal;
+            
+            if (msgsnd(msg_queue_id, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
+                requests[sent].status = rpc_timed_out ? ETIMEDOUT : errno;
+                snprintf(requests[sent].response, sizeof(requests[sent].response),
+                         "Error: Failed to send request: %s", strerror(requests[sent].status));
+                answered++;
+                sent++;
+                if (rpc_timed_out) break;
+                continue;
+            }
+            sent++;
+            in_flight++;
+        }
+        if (in_flight == 0) {
+            if (rpc_timed_out) break;
+            continue;
+        }
+        
+        if (receive_reply(&msg) == -1) break;
+        
+        unsigned int slot = msg.request_id - base;
+        if (slot < (unsigned int)sent && requests[slot].response[0] == '\0') {
+            requests[slot].status = msg.status;
+            memcpy(requests[slot].response, msg.response, sizeof(requests[slot].response));
+            requests[slot].response[sizeof(requests[slot].response) - 1] = '\0';
+            in_flight--;
+            answered++;
+        }
+    }
+    
+    memset(&disarm, 0, sizeof(disarm));
+    setitimer(ITIMER_REAL, &disarm, NULL);
+    sigaction(SIGALRM, &old_action, NULL);
+    
+    for (int i = 0; i < count; i++) {
+        if (requests[i].response[0] == '\0') {
+            requests[i].status = ETIMEDOUT;
+            strcpy(requests[i].response, "Error: No response from daemon");
+        }
+    }
+    
+    return answered;
+}
+
+/* Send one request and wait for its reply; returns its status */
+int rpc_call(rpc_request_t *request, int timeout_ms) {
+    if (rpc_pipeline(request, 1, timeout_ms) == -1) {
+        request->status = EIO;
+        strcpy(request->response, "Error: Message queue unavailable");
+    }
+    return request->status;
+}
+
@@ -3,12 +3,31 @@
 
 #include "common.h"
 
+#define RPC_WINDOW 16                 /* Requests in flight per client */
+#define RPC_DEFAULT_TIMEOUT_MS 5000   /* Longest wait for the next reply */
+#define RPC_TRACKED_CLIENTS 64        /* Clients the server keeps reply state for */
+#define RPC_REQUEST_HEADROOM 8        /* Queue slots replies leave free for requests */
+#define RPC_CLIENT_REPLIES 8          /* Replies one client may hold once the queue is half full */
+
+/* One request of an RPC batch, with its reply filled in */
+typedef struct {
+    msg_type_t cmd;
+    pid_t target_pid;
+    int signal;
+    int status;               /* 0 on success, else an errno value (ETIMEDOUT: no reply) */
+    char response[256];
+} rpc_request_t;
+
 /* Message Queue Functions */
 int init_message_queue(void);
 void destroy_message_queue(void);
 int send_command(msg_type_t cmd, pid_t pid, int signal);
 int receive_command(process_msg_t *msg);
-int send_response(long mtype, const char *response);
+int send_response(const process_msg_t *request, int status, const char *response);
+
+/* RPC Client Functions */
+int rpc_call(rpc_request_t *request, int timeout_ms);
+int rpc_pipeline(rpc_request_t *requests, int count, int timeout_ms);
 
 #endif /* MESSAGE_QUEUE_H */
 
@@ -0,0 +1,370 @@
+#include "pidfd_watch.h"
+#include "proc_reader.h"
+#include "supervisor.h"
+#include "logger.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+/* Same number on every architecture since Linux 5.1 */
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/* epoll data of a watched pidfd: PID << 32 | fd */
+#define WATCH_DATA(pid, fd) (((uint64_t)(uint32_t)(pid) << 32) | (uint32_t)(fd))
+#define WATCH_PID(data) ((pid_t)((data) >> 32))
+#define WATCH_FD(data) ((int)((data) & 0xffffffffu))
+#define WATCH_WAKE 0              /* epoll data of the stop eventfd: no process has PID 0 */
+
+/* One watched process: its pidfd pins the exact process, not just the PID */
+typedef struct watch_entry {
+    pid_t pid;
+    int pidfd;
+    unsigned long long starttime;   /* Identity the pidfd was verified against */
+    struct watch_entry *next;
+} watch_entry_t;
+
+static watch_entry_t *buckets[PIDFD_BUCKETS];
+static int watched = 0;
+static int watch_budget = 0;
+static int epoll_fd = -1;
+static int wake_fd = -1;          /* Written by stop_pidfd_watch() to end the wait */
+static volatile int watch_running = 0;
+static pthread_t watch_tid;
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t probe_once = PTHREAD_ONCE_INIT;
+static int pidfd_supported = 0;
+
+static int sys_pidfd_open(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int sys_pidfd_send_signal(int pidfd, int sig) {
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+
+/* Check once whether the kernel has pidfds (Linux 5.3+) */
+static void probe_pidfd(void) {
+    int fd = sys_pidfd_open(getpid());
+    
+    if (fd != -1) {
+        close(fd);
+        pidfd_supported = 1;
+    }
+}
+
+/* Start time of the process now holding pid; 0 if it cannot be read */
+static unsigned long long read_starttime(pid_t pid) {
+    system_snapshot_t sys;
+    process_info_t info;
+    
+    memset(&sys, 0, sizeof(sys));
+    if (read_process_stat(pid, &sys, &info) != 0) {
+        return 0;
+    }
+    return info.starttime;
+}
+
+/*
+ * Open a pidfd for the process started at starttime. The pidfd pins
+ * whichever process held the PID at open time; a start time read after
+ * that still matching means it is the expected one (a reused PID would
+ * also need the same clock tick). Returns the fd, or -1 with errno set
+ * (ESRCH when the PID now belongs to another process).
+ */
+static int open_verified(pid_t pid, unsigned long long starttime) {
+    int fd = sys_pidfd_open(pid);
+    
+    if (fd == -1) {
+        return -1;
+    }
+    if (read_starttime(pid) != starttime) {
+        close(fd);
+        errno = ESRCH;
+        return -1;
+    }
+    return fd;
+}
+
+/* Whether the process behind a pidfd has exited (its pidfd is readable) */
+static int pidfd_exited(int pidfd) {
+    struct pollfd pfd = { pidfd, POLLIN, 0 };
+    
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/* Find the entry of a PID (caller holds watch_lock) */
+static watch_entry_t* find_entry(pid_t pid) {
+    watch_entry_t *entry = buckets[pid & (PIDFD_BUCKETS - 1)];
+    
+    while (entry != NULL && entry->pid != pid) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/* Unlink an entry, stop watching its pidfd and free it (caller holds watch_lock) */
+static void drop_entry(watch_entry_t *entry) {
+    watch_entry_t **link = &buckets[entry->pid & (PIDFD_BUCKETS - 1)];
+    
+    while (*link != NULL && *link != entry) {
+        link = &(*link)->next;
+    }
+    if (*link == entry) {
+        *link = entry->next;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry->pidfd, NULL);
+    close(entry->pidfd);
+    free(entry);
+    watched--;
+}
+
+/*
+ * Hold a pidfd for a process just stored in the table, so its exit is
+ * reported at once and signals cannot reach a later owner of its PID.
+ * Called from every insertion site; a process already watched under the
+ * same identity costs one hash lookup. Zombies have exited already and
+ * are left to the table scans.
+ */
+void watch_process(const process_info_t *info) {
+    watch_entry_t *entry;
+    int fd;
+    
+    if (!watch_running || info->is_zombie) {
+        return;
+    }
+    
+    pthread_mutex_lock(&watch_lock);
+    entry = find_entry(info->pid);
+    if (entry != NULL && entry->starttime == info->starttime) {
+        pthread_mutex_unlock(&watch_lock);
+        return;
+    }
+    int full = watched >= watch_budget;
+    pthread_mutex_unlock(&watch_lock);
+    
+    if (full && entry == NULL) {
+        return;
+    }
+    
+    /* Opening and verifying reads /proc, so it runs without the lock */
+    fd = open_verified(info->pid, info->starttime);
+    if (fd == -1) {
+        return;
+    }
+    
+    pthread_mutex_lock(&watch_lock);
+    
+    /* An entry left by an earlier owner of the PID is stale now */
+    entry = find_entry(info->pid);
+    if (entry != NULL && entry->starttime != info->starttime) {
+        drop_entry(entry);
+        entry = NULL;
+    }
+    if (entry != NULL || watched >= watch_budget) {
+        pthread_mutex_unlock(&watch_lock);
+        close(fd);
+        return;
+    }
+    
+    entry = (watch_entry_t*)malloc(sizeof(watch_entry_t));
+    if (entry == NULL) {
+        pthread_mutex_unlock(&watch_lock);
+        close(fd);
+        return;
+    }
+    entry->pid = info->pid;
+    entry->pidfd = fd;
+    entry->starttime = info->starttime;
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = WATCH_DATA(info->pid, fd);
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        pthread_mutex_unlock(&watch_lock);
+        free(entry);
+        close(fd);
+        return;
+    }
+    
+    entry->next = buckets[info->pid & (PIDFD_BUCKETS - 1)];
+    buckets[info->pid & (PIDFD_BUCKETS - 1)] = entry;
+    watched++;
+    
+    pthread_mutex_unlock(&watch_lock);
+}
+
+/*
+ * Send sig to the process started at starttime, never to a later owner of
+ * its PID: through the held pidfd when the process is watched, else through
+ * a pidfd opened and verified for this call. Kernels without pidfds fall
+ * back to kill() after the same start time check. Returns 0 or an errno.
+ */
+int signal_process(pid_t pid, unsigned long long starttime, int sig) {
+    watch_entry_t *entry;
+    int fd, rc;
+    
+    pthread_once(&probe_once, probe_pidfd);
+    
+    if (!pidfd_supported) {
+        if (read_starttime(pid) != starttime) return ESRCH;
+        return kill(pid, sig) == 0 ? 0 : errno;
+    }
+    
+    /* The lock keeps the exit thread from closing the pidfd under us */
+    pthread_mutex_lock(&watch_lock);
+    entry = find_entry(pid);
+    if (entry != NULL && entry->starttime == starttime) {
+        rc = sys_pidfd_send_signal(entry->pidfd, sig) == 0 ? 0 : errno;
+        pthread_mutex_unlock(&watch_lock);
+        return rc;
+    }
+    pthread_mutex_unlock(&watch_lock);
+    
+    fd = open_verified(pid, starttime);
+    if (fd == -1) {
+        return errno;
+    }
+    rc = sys_pidfd_send_signal(fd, sig) == 0 ? 0 : errno;
+    close(fd);
+    return rc;
+}
+
+/* Handle one readable pidfd: forget the process and report its exit */
+static void handle_exit_event(uint64_t data) {
+    pid_t pid = WATCH_PID(data);
+    unsigned long long starttime;
+    watch_entry_t *entry;
+    
+    pthread_mutex_lock(&watch_lock);
+    
+    /* The event may be stale: the entry replaced, or its fd number reused */
+    entry = find_entry(pid);
+    if (entry == NULL || entry->pidfd != WATCH_FD(data) || !pidfd_exited(entry->pidfd)) {
+        pthread_mutex_unlock(&watch_lock);
+        return;
+    }
+    starttime = entry->starttime;
+    drop_entry(entry);
+    
+    pthread_mutex_unlock(&watch_lock);
+    
+    handle_process_exit(pid, starttime);
+}
+
+/* Exit thread: waits on every watched pidfd at once, and on the stop eventfd */
+static void* pidfd_watch_thread(void *arg) {
+    struct epoll_event events[PIDFD_EVENTS_BATCH];
+    (void)arg;
+    
+    log_message("PIDFD watch thread started\n");
+    
+    while (watch_running) {
+        int n = epoll_wait(epoll_fd, events, PIDFD_EVENTS_BATCH, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            log_message("PIDFD watch epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+        
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == WATCH_WAKE) continue;
+            handle_exit_event(events[i].data.u64);
+        }
+    }
+    
+    log_message("PIDFD watch thread stopped\n");
+    return NULL;
+}
+
+/*
+ * Start watching process exits through pidfds. Call after init_fd_cache()
+ * has raised RLIMIT_NOFILE; a quarter of it goes to pidfds, and processes
+ * beyond that are signalled through short-lived pidfds instead. Returns -1
+ * when the kernel has no pidfds (exits are then seen by the scans only).
+ */
+int start_pidfd_watch(void) {
+    struct rlimit rl;
+    
+    if (watch_running) {
+        return 0;
+    }
+    
+    pthread_once(&probe_once, probe_pidfd);
+    if (!pidfd_supported) {
+        log_message("pidfds unavailable, signalling by PID with start time checks\n");
+        return -1;
+    }
+    
+    watch_budget = 1024;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        watch_budget = (int)(rl.rlim_cur / 4);
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        log_message("PIDFD watch unavailable: epoll_create1: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = WATCH_WAKE;
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        log_message("PIDFD watch unavailable: eventfd: %s\n", strerror(errno));
+        if (wake_fd != -1) close(wake_fd);
+        close(epoll_fd);
+        wake_fd = epoll_fd = -1;
+        return -1;
+    }
+    
+    watch_running = 1;
+    if (pthread_create(&watch_tid, NULL, pidfd_watch_thread, NULL) != 0) {
+        perror("pthread_create pidfd watch");
+        watch_running = 0;
+        close(wake_fd);
+        close(epoll_fd);
+        wake_fd = epoll_fd = -1;
+        return -1;
+    }
+    
+    log_message("PIDFD watch enabled (budget %d descriptors)\n", watch_budget);
+    return 0;
+}
+
+/* Stop the exit thread and close every pidfd */
+void stop_pidfd_watch(void) {
+    uint64_t one = 1;
+    
+    if (!watch_running) {
+        return;
+    }
+    
+    watch_running = 0;
+    if (write(wake_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+        log_message("PIDFD watch wake-up failed: %s\n", strerror(errno));
+    }
+    pthread_join(watch_tid, NULL);
+    
+    pthread_mutex_lock(&watch_lock);
+    for (int i = 0; i < PIDFD_BUCKETS; i++) {
+        while (buckets[i] != NULL) {
+            drop_entry(buckets[i]);
+        }
+    }
+    pthread_mutex_unlock(&watch_lock);
+    
+    close(wake_fd);
+    close(epoll_fd);
+    wake_fd = epoll_fd = -1;
+    
+    log_message("PIDFD watch stopped\n");
+}
+
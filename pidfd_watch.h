@@ -0,0 +1,15 @@
+#ifndef PIDFD_WATCH_H
+#define PIDFD_WATCH_H
+
+#include "common.h"
+
+#define PIDFD_BUCKETS 4096          /* Hash buckets (power of two) */
+#define PIDFD_EVENTS_BATCH 64       /* Exit notifications per epoll_wait() */
+
+/* PIDFD Watch Functions */
+int start_pidfd_watch(void);
+void stop_pidfd_watch(void);
+void watch_process(const process_info_t *info);
+int signal_process(pid_t pid, unsigned long long starttime, int sig);
+
+#endif /* PIDFD_WATCH_H */
@@ -0,0 +1,216 @@
+#include "proc_events.h"
+#include "process_table.h"
+#include "proc_reader.h"
+#include "stats.h"
+#include "cmdline_cache.h"
+#include "logger.h"
+#include "pidfd_watch.h"
+#include "scheduler.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#define EVENT_BUF_LEN 8192
+
+static pthread_t events_tid;
+static int events_sock = -1;
+static volatile int events_running = 0;
+static volatile int resync_requested = 0;
+static process_table_t *table = NULL;
+
+/* Subscribe or unsubscribe from proc connector multicast */
+static int send_mcast_op(int sock, enum proc_cn_mcast_op op) {
+    struct {
+        struct nlmsghdr nl_hdr;
+        struct cn_msg cn_msg;
+        enum proc_cn_mcast_op op;
+    } __attribute__((packed)) req;
+    
+    memset(&req, 0, sizeof(req));
+    req.nl_hdr.nlmsg_len = sizeof(req);
+    req.nl_hdr.nlmsg_type = NLMSG_DONE;
+    req.nl_hdr.nlmsg_pid = getpid();
+    req.cn_msg.id.idx = CN_IDX_PROC;
+    req.cn_msg.id.val = CN_VAL_PROC;
+    req.cn_msg.len = sizeof(enum proc_cn_mcast_op);
+    req.op = op;
+    
+    if (send(sock, &req, sizeof(req), 0) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Apply one proc connector event to the process table */
+static void handle_proc_event(const struct proc_event *ev, system_snapshot_t *sys,
+                              time_t *sys_time) {
+    process_info_t info;
+    time_t now;
+    
+    switch (ev->what) {
+        case PROC_EVENT_FORK:
+            /* Threads share the parent's tgid; only new processes matter */
+            if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid) {
+                break;
+            }
+            
+            now = time(NULL);
+            if (now != *sys_time) {
+                read_system_snapshot(sys);
+                *sys_time = now;
+            }
+            
+            if (sample_process(ev->event_data.fork.child_pid, sys, &info) == 0 &&
+                upsert_process(table, &info) >= 0) {
+                watch_process(&info);
+                scheduler_track(&info);
+            }
+            break;
+            
+        case PROC_EVENT_EXEC:
+            invalidate_process_strings(ev->event_data.exec.process_tgid);
+            mark_process_dirty(table, ev->event_data.exec.process_tgid);
+            break;
+            
+        case PROC_EVENT_COMM:
+            mark_process_dirty(table, ev->event_data.comm.process_tgid);
+            break;
+            
+        case PROC_EVENT_EXIT:
+            if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) {
+                break;
+            }
+            /*
+             * The task is not a zombie yet. Re-sample it so the entry
+             * records state Z; the refresh removes it once it is reaped.
+             */
+            mark_process_dirty(table, ev->event_data.exit.process_pid);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+/* Event thread: receives proc connector messages until stopped */
+static void* proc_events_thread(void *arg) {
+    char buf[EVENT_BUF_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+    system_snapshot_t sys;
+    time_t sys_time = 0;
+    ssize_t len;
+    (void)arg;
+    
+    log_message("Process event thread started\n");
+    
+    while (events_running) {
+        len = recv(events_sock, buf, sizeof(buf), 0);
+        if (len == -1) {
+            if (errno == ENOBUFS) {
+                /* The kernel dropped events; the reader pool rescans /proc */
+                log_message("Process event overflow, requesting resync\n");
+                resync_requested = 1;
+            } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_message("Process event recv failed: %s\n", strerror(errno));
+                break;
+            }
+            continue;
+        }
+        
+        for (struct nlmsghdr *nlh = (struct nlmsghdr*)buf; NLMSG_OK(nlh, (size_t)len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_NOOP) {
+                continue;
+            }
+            
+            struct cn_msg *cn = (struct cn_msg*)NLMSG_DATA(nlh);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) {
+                continue;
+            }
+            
+            handle_proc_event((const struct proc_event*)cn->data, &sys, &sys_time);
+        }
+    }
+    
+    /* Fall back to polling if the socket failed underneath us */
+    events_running = 0;
+    resync_requested = 1;
+    log_message("Process event thread stopped\n");
+    return NULL;
+}
+
+/* Open the proc connector; returns -1 (polling fallback) when unavailable */
+int start_proc_events(void) {
+    struct sockaddr_nl addr;
+    struct timeval timeout = { 0, 500000 };
+    
+    if (events_running) {
+        return 0;
+    }
+    
+    table = attach_shared_memory();
+    if (table == NULL) {
+        return -1;
+    }
+    
+    events_sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (events_sock == -1) {
+        log_message("Process events unavailable (%s), polling /proc\n", strerror(errno));
+        return -1;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0;
+    
+    /* Without CAP_NET_ADMIN bind or subscribe fails */
+    if (bind(events_sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        send_mcast_op(events_sock, PROC_CN_MCAST_LISTEN) == -1) {
+        log_message("Process events unavailable (%s), polling /proc\n", strerror(errno));
+        close(events_sock);
+        events_sock = -1;
+        return -1;
+    }
+    
+    /* Wake up periodically so stop_proc_events() is noticed */
+    setsockopt(events_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    events_running = 1;
+    if (pthread_create(&events_tid, NULL, proc_events_thread, NULL) != 0) {
+        perror("pthread_create proc events");
+        events_running = 0;
+        close(events_sock);
+        events_sock = -1;
+        return -1;
+    }
+    
+    log_message("Process events enabled (netlink proc connector)\n");
+    return 0;
+}
+
+/* Stop the event thread and unsubscribe */
+void stop_proc_events(void) {
+    if (events_sock == -1) {
+        return;
+    }
+    
+    events_running = 0;
+    pthread_join(events_tid, NULL);
+    
+    send_mcast_op(events_sock, PROC_CN_MCAST_IGNORE);
+    close(events_sock);
+    events_sock = -1;
+    
+    log_message("Process events stopped\n");
+}
+
+/* Whether table membership is currently maintained by events */
+int proc_events_active(void) {
+    return events_running;
+}
+
+/* Consume a pending request for a full /proc rescan */
+int proc_events_take_resync(void) {
+    return __atomic_exchange_n(&resync_requested, 0, __ATOMIC_ACQ_REL);
+}
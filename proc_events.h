@@ -0,0 +1,12 @@
+#ifndef PROC_EVENTS_H
+#define PROC_EVENTS_H
+
+#include "common.h"
+
+/* Process Event Functions (netlink proc connector) */
+int start_proc_events(void);
+void stop_proc_events(void);
+int proc_events_active(void);
+int proc_events_take_resync(void);
+
+#endif /* PROC_EVENTS_H */
@@ -3,46 +3,113 @@
 #include "stats.h"
 #include "logger.h"
 #include "memory_allocator.h"
+#include "work_queue.h"
+#include "proc_events.h"
+#include "fd_cache.h"
+#include "uring_reader.h"
+#include "cmdline_cache.h"
+#include "pidfd_watch.h"
+#include "scheduler.h"
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#define READER_CYCLE_SECS 2         /* Seconds between reader pool cycles */
+#define READER_CHUNK_PIDS 64        /* PIDs per work chunk */
+#define READER_PIDS_PER_THREAD 256  /* Live PIDs that justify another thread */
+#define READER_MAX_THREADS 64
+#define READER_RESYNC_CYCLES 15     /* Full rescan interval when events are on */
+
+/* Record layout returned by getdents64 */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
 
 static pthread_t *reader_threads = NULL;
-static int num_threads = 4;
+static pthread_t coordinator_tid;
+static int coordinator_started = 0;
+static work_deque_t *reader_deques = NULL;
+static int num_threads = 0;
 static int running = 0;
 static process_table_t *table = NULL;
 
-/* Read process stat file */
-int read_process_stat(pid_t pid, process_info_t *info) {
-    char stat_path[MAX_PATH_LEN];
-    FILE *fp;
-    unsigned long utime, stime;
-    unsigned long vsize;
-    long rss;
-    char state_char;
-    
-    snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
-    fp = fopen(stat_path, "r");
-    if (fp == NULL) {
+/* Reader pool cycle state, guarded by cycle_lock */
+static pthread_mutex_t cycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cycle_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cycle_done = PTHREAD_COND_INITIALIZER;
+static unsigned long cycle_number = 0;
+static int active_threads = 0;
+static int finished_threads = 0;
+static system_snapshot_t cycle_sys;
+static int cycle_full_scan = 1;
+static reader_backend_t reader_backend = READER_BACKEND_SYNC;
+
+/* Skip to the start of the next space-separated field */
+static char* next_field(char *p) {
+    while (*p != '\0' && *p != ' ') p++;
+    while (*p == ' ') p++;
+    return p;
+}
+
+/* Parse a /proc/<pid>/stat line into info */
+int parse_process_stat(char *buf, const system_snapshot_t *sys, process_info_t *info) {
+    char *open_paren;
+    char *close_paren;
+    char *p;
+    size_t name_len;
+    int field;
+    
+    /* comm may contain spaces and parentheses, so it ends at the last ')' */
+    open_paren = strchr(buf, '(');
+    close_paren = strrchr(buf, ')');
+    if (open_paren == NULL || close_paren == NULL || close_paren < open_paren) {
         return -1;
     }
     
-    /* Parse /proc/pid/stat */
-    if (fscanf(fp, "%d %*s %c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
-               "%lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %lu %ld",
-               &info->pid, &state_char, &info->ppid,
-               &utime, &stime, &vsize, &rss) < 7) {
-        fclose(fp);
+    info->pid = (pid_t)strtol(buf, NULL, 10);
+    
+    name_len = (size_t)(close_paren - open_paren - 1);
+    if (name_len >= sizeof(info->name)) {
+        name_len = sizeof(info->name) - 1;
+    }
+    memcpy(info->name, open_paren + 1, name_len);
+    info->name[name_len] = '\0';
+    
+    if (close_paren[1] != ' ' || close_paren[2] == '\0') {
         return -1;
     }
-    fclose(fp);
     
-    info->utime = utime;
-    info->stime = stime;
-    info->vsize = vsize;
-    info->rss = rss;
+    /* Field 3 (state) follows ") "; numbering matches proc(5) */
+    p = close_paren + 2;
+    char state_char = *p;
+    
+    for (field = 3; field <= 24 && *p != '\0'; field++) {
+        switch (field) {
+            case 4:  info->ppid = (pid_t)strtol(p, NULL, 10); break;
+            case 14: info->utime = strtoul(p, NULL, 10); break;
+            case 15: info->stime = strtoul(p, NULL, 10); break;
+            case 22: info->starttime = strtoull(p, NULL, 10); break;
+            case 23: info->vsize = strtoul(p, NULL, 10); break;
+            case 24: info->rss = strtol(p, NULL, 10) * sys->page_size_kb; break;
+            default: break;
+        }
+        if (field < 24) {
+            p = next_field(p);
+        }
+    }
+    
+    if (field <= 24) {
+        return -1;  /* Truncated line */
+    }
     
     /* Convert state character to enum */
+    info->is_zombie = 0;
     switch (state_char) {
         case 'R': info->state = PROC_RUNNING; break;
-        case 'S': case 'D': info->state = PROC_SLEEPING; break;
+        case 'S': case 'D': case 'I': info->state = PROC_SLEEPING; break;
         case 'T': case 't': info->state = PROC_STOPPED; break;
         case 'Z': info->state = PROC_ZOMBIE; info->is_zombie = 1; break;
         default: info->state = PROC_DEAD; break;
@@ -51,117 +118,362 @@ int read_process_stat(pid_t pid, process_info_t *info) {
     return 0;
 }
 
-/* Read process status file */
-int read_process_status(pid_t pid, process_info_t *info) {
-    char status_path[MAX_PATH_LEN];
-    FILE *fp;
-    char line[256];
-    
-    snprintf(status_path, sizeof(status_path), "/proc/%d/status", pid);
-    fp = fopen(status_path, "r");
-    if (fp == NULL) {
+/* Read process stat file with a single read() */
+int read_process_stat(pid_t pid, const system_snapshot_t *sys, process_info_t *info) {
+    char buf[1024];
+    ssize_t len;
+    
+    len = read_proc_file(pid, PROC_FILE_STAT, buf, sizeof(buf) - 1);
+    if (len <= 0) {
         return -1;
     }
+    buf[len] = '\0';
     
-    /* Read Name field */
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        if (strncmp(line, "Name:", 5) == 0) {
-            sscanf(line, "Name:\t%s", info->name);
-            break;
-        }
+    return parse_process_stat(buf, sys, info);
+}
+
+/* Sample everything about a process in one pass */
+int sample_process(pid_t pid, const system_snapshot_t *sys, process_info_t *info) {
+    memset(info, 0, sizeof(process_info_t));
+    
+    if (read_process_stat(pid, sys, info) != 0) {
+        return -1;
     }
-    fclose(fp);
     
+    /* cmdline is only re-read when the process identity or comm changed */
+    fill_process_strings(info);
+    update_process_statistics(info, sys);
     return 0;
 }
 
-/* Read process cmdline */
-int read_process_cmdline(pid_t pid, char *cmdline, size_t max_len) {
-    char cmdline_path[MAX_PATH_LEN];
-    FILE *fp;
-    size_t len;
-    
-    snprintf(cmdline_path, sizeof(cmdline_path), "/proc/%d/cmdline", pid);
-    fp = fopen(cmdline_path, "r");
-    if (fp == NULL) {
+/* Enumerate live PIDs from /proc with raw getdents64; returns the count */
+int enumerate_pids(pid_t **pids, int *capacity) {
+    char buf[16384];
+    int count = 0;
+    long nread;
+    int fd;
+    
+    fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    count_proc_syscalls(1);
+    if (fd == -1) {
+        perror("open /proc");
         return -1;
     }
     
-    len = fread(cmdline, 1, max_len - 1, fp);
-    cmdline[len] = '\0';
-    
-    /* Replace null bytes with spaces */
-    for (size_t i = 0; i < len; i++) {
-        if (cmdline[i] == '\0') {
-            cmdline[i] = ' ';
+    while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        count_proc_syscalls(1);
+        for (long pos = 0; pos < nread; ) {
+            struct linux_dirent64 *entry = (struct linux_dirent64*)(buf + pos);
+            const char *name = entry->d_name;
+            pos += entry->d_reclen;
+            
+            /* Process directories are the all-numeric names */
+            if (entry->d_type != DT_DIR || !isdigit((unsigned char)name[0])) {
+                continue;
+            }
+            
+            pid_t pid = 0;
+            while (isdigit((unsigned char)*name)) {
+                pid = pid * 10 + (*name++ - '0');
+            }
+            if (*name != '\0') {
+                continue;
+            }
+            
+            if (count == *capacity) {
+                int new_capacity = *capacity ? *capacity * 2 : 1024;
+                pid_t *grown = (pid_t*)realloc(*pids, new_capacity * sizeof(pid_t));
+                if (grown == NULL) {
+                    close(fd);
+                    return count;
+                }
+                *pids = grown;
+                *capacity = new_capacity;
+            }
+            (*pids)[count++] = pid;
         }
     }
     
-    fclose(fp);
+    if (nread < 0) {
+        perror("getdents64 /proc");
+    }
+    
+    close(fd);
+    count_proc_syscalls(2);  /* The final getdents64 and close */
+    return count;
+}
+
+/* Select the full-scan backend; returns -1 (and stays sync) if unavailable */
+int set_reader_backend(reader_backend_t backend) {
+    if (backend == READER_BACKEND_URING && !uring_reader_available()) {
+        reader_backend = READER_BACKEND_SYNC;
+        return -1;
+    }
+    
+    reader_backend = backend;
+    return 0;
+}
+
+/* Get the full-scan backend */
+reader_backend_t get_reader_backend(void) {
+    return reader_backend;
+}
+
+/* Sample a list of PIDs with the selected backend */
+int scan_processes(const pid_t *pids, int count, const system_snapshot_t *sys,
+                   sample_callback_t callback, void *ctx) {
+    process_info_t info;
+    
+    if (reader_backend == READER_BACKEND_URING &&
+        uring_scan_processes(pids, count, sys, callback, ctx) == 0) {
+        return 0;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (sample_process(pids[i], sys, &info) == 0) {
+            callback(&info, ctx);
+        }
+    }
     return 0;
 }
 
-/* Thread function to read process info */
+/* Samples of one work chunk, committed to the table together */
+typedef struct {
+    process_info_t infos[READER_CHUNK_PIDS];
+    int slots[READER_CHUNK_PIDS];
+    int count;
+} sample_batch_t;
+
+/* Queue one sample for the chunk's commit */
+static void batch_sample(process_info_t *info, void *ctx) {
+    sample_batch_t *batch = (sample_batch_t*)ctx;
+    
+    if (batch->count < READER_CHUNK_PIDS) {
+        batch->infos[batch->count++] = *info;
+    }
+}
+
+/*
+ * Commit a chunk's samples in one pass over the locks it needs, then hand
+ * the stored ones to the exit watch, the scheduler and the history log.
+ * Only a full scan inserts; a dirty refresh never re-adds a process that
+ * exited meanwhile.
+ */
+static void commit_batch(sample_batch_t *batch, int insert) {
+    commit_processes(table, batch->infos, batch->count, insert, batch->slots);
+    
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->slots[i] < 0) continue;
+        if (insert) {
+            watch_process(&batch->infos[i]);
+            scheduler_track(&batch->infos[i]);
+        }
+        log_historical_stats(&batch->infos[i]);
+    }
+    batch->count = 0;
+}
+
+/*
+ * Re-sample a PID flagged by an event. A PID gone from /proc is dropped at
+ * once, but only the instance seen before sampling: a fork event may have
+ * put a new process under the same PID meanwhile.
+ */
+static void refresh_dirty_process(pid_t pid, const system_snapshot_t *sys, sample_batch_t *batch) {
+    process_info_t info;
+    unsigned long long starttime = 0;
+    
+    if (get_process(table, pid, &info) == 0) {
+        starttime = info.starttime;
+    }
+    
+    if (sample_process(pid, sys, &info) == 0) {
+        batch_sample(&info, batch);
+    } else {
+        if (starttime != 0) {
+            remove_process_instance(table, pid, starttime);
+        }
+        forget_cpu_sample(pid);
+        evict_proc_fds(pid);
+        forget_process_strings(pid);
+    }
+}
+
+/* Reader thread: drains its deque each cycle, then steals from the others */
 void* read_proc_info(void *arg) {
-    pid_t start_pid = (pid_t)(long)arg;
-    pid_t pid;
-    process_info_t *info;
+    int self = (int)(long)arg;
+    unsigned long seen_cycle = 0;
+    work_chunk_t chunk;
+    sample_batch_t *batch;
+    
+    batch = (sample_batch_t*)calloc(1, sizeof(sample_batch_t));
+    if (batch == NULL) {
+        perror("calloc sample batch");
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&cycle_lock);
     
     while (running) {
-        /* Scan processes assigned to this thread */
-        for (pid = start_pid; pid < start_pid + 1000 && running; pid++) {
-            /* Allocate memory for process info */
-            info = (process_info_t*)alloc_mem(sizeof(process_info_t));
-            if (info == NULL) {
-                continue;
-            }
-            
-            memset(info, 0, sizeof(process_info_t));
-            info->pid = pid;
-            info->is_zombie = 0;
-            
-            /* Try to read process information */
-            if (read_process_stat(pid, info) == 0) {
-                read_process_status(pid, info);
-                read_process_cmdline(pid, info->cmdline, sizeof(info->cmdline));
-                
-                /* Update statistics */
-                update_process_statistics(info);
-                
-                /* Update process table */
-                lock_table();
-                int index = find_process_index(table, pid);
-                if (index < 0 && table->count < MAX_PROCESSES) {
-                    index = table->count;
-                    table->count++;
-                }
-                
-                if (index >= 0) {
-                    update_process_info(table, index, info);
-                    log_historical_stats(info);
+        while (running && cycle_number == seen_cycle) {
+            pthread_cond_wait(&cycle_start, &cycle_lock);
+        }
+        if (!running) break;
+        
+        seen_cycle = cycle_number;
+        int active = active_threads;
+        
+        /* Not needed for this many live PIDs */
+        if (self >= active) continue;
+        
+        pthread_mutex_unlock(&cycle_lock);
+        
+        while (running && find_work(reader_deques, active, self, &chunk)) {
+            /* Sampling takes no table lock; the chunk is committed at once */
+            if (cycle_full_scan) {
+                scan_processes(chunk.pids, chunk.count, &cycle_sys, batch_sample, batch);
+            } else {
+                for (int i = 0; i < chunk.count && running; i++) {
+                    refresh_dirty_process(chunk.pids[i], &cycle_sys, batch);
                 }
-                unlock_table();
             }
-            
-            free_mem(info);
-            
-            /* Small delay to prevent overwhelming the system */
-            usleep(1000);
+            commit_batch(batch, cycle_full_scan);
+        }
+        
+        pthread_mutex_lock(&cycle_lock);
+        if (++finished_threads == active) {
+            pthread_cond_signal(&cycle_done);
+        }
+    }
+    
+    pthread_mutex_unlock(&cycle_lock);
+    free(batch);
+    return NULL;
+}
+
+/* Coordinator thread: enumerates PIDs and hands chunks to the reader threads */
+static void* reader_coordinator(void *arg) {
+    pid_t *pids = NULL;
+    int capacity = 0;
+    int live;
+    int cycles_since_scan = READER_RESYNC_CYCLES;  /* First cycle is a full scan */
+    (void)arg;
+    
+    pthread_mutex_lock(&cycle_lock);
+    
+    while (running) {
+        pthread_mutex_unlock(&cycle_lock);
+        
+        /*
+         * With proc events maintaining membership, only PIDs flagged by
+         * exec/comm events are re-sampled; /proc is rescanned on overflow
+         * and every READER_RESYNC_CYCLES as a safety net.
+         */
+        int resync = proc_events_take_resync();
+        int full_scan = !proc_events_active() || resync ||
+                        cycles_since_scan++ >= READER_RESYNC_CYCLES;
+        time_t scan_start = time(NULL);
+        
+        if (full_scan) {
+            live = enumerate_pids(&pids, &capacity);
+            cycles_since_scan = 0;
+        } else {
+            live = collect_dirty_processes(table, &pids, &capacity);
+        }
+        read_system_snapshot(&cycle_sys);
+        
+        /* Thread count follows the live PID count, bounded by the pool */
+        int active = (live + READER_PIDS_PER_THREAD - 1) / READER_PIDS_PER_THREAD;
+        if (active < 1) active = 1;
+        if (active > num_threads) active = num_threads;
+        
+        for (int i = 0, c = 0; i < live; i += READER_CHUNK_PIDS, c++) {
+            work_chunk_t chunk;
+            chunk.pids = pids + i;
+            chunk.count = live - i < READER_CHUNK_PIDS ? live - i : READER_CHUNK_PIDS;
+            chunk.batch = NULL;
+            if (push_work(&reader_deques[c % active], chunk) != 0) {
+                /* Out of memory: this chunk waits for the next cycle */
+                break;
+            }
         }
         
+        pthread_mutex_lock(&cycle_lock);
+        cycle_full_scan = full_scan;
+        active_threads = active;
+        finished_threads = 0;
+        cycle_number++;
+        pthread_cond_broadcast(&cycle_start);
+        
+        while (running && finished_threads < active_threads) {
+            pthread_cond_wait(&cycle_done, &cycle_lock);
+        }
+        if (!running) break;
+        pthread_mutex_unlock(&cycle_lock);
+        
+        /* Drop exited processes and their CPU samples */
+        if (full_scan && live > 0) {
+            retain_processes(table, pids, live, scan_start);
+        }
+        prune_cpu_samples(CPU_SAMPLE_MAX_AGE);
+        prune_process_strings(STRINGS_MAX_AGE);
+        
+        /* Trim trailing tombstones a bounded step at a time */
+        compact_table(table, TABLE_COMPACT_STEP);
+        
         /* Sleep before next scan cycle */
-        sleep(2);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += READER_CYCLE_SECS;
+        
+        pthread_mutex_lock(&cycle_lock);
+        while (running) {
+            if (pthread_cond_timedwait(&cycle_start, &cycle_lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
     }
     
+    pthread_mutex_unlock(&cycle_lock);
+    
+    /* Drop chunks left over by an interrupted cycle before freeing pids */
+    for (int i = 0; i < num_threads; i++) {
+        reset_work_deque(&reader_deques[i]);
+    }
+    free(pids);
     return NULL;
 }
 
-/* Collect all processes from /proc */
+/* Shadow buffer filled by collect_all_processes() */
+typedef struct {
+    process_info_t *infos;
+    int count;
+    int capacity;
+} shadow_buffer_t;
+
+/* Append one sample to the shadow buffer */
+static void store_shadow_sample(process_info_t *info, void *ctx) {
+    shadow_buffer_t *shadow = (shadow_buffer_t*)ctx;
+    
+    /* PIDs forked since the enumeration can outnumber the initial size */
+    if (shadow->count == shadow->capacity) {
+        int new_capacity = shadow->capacity * 2;
+        process_info_t *grown = (process_info_t*)realloc(shadow->infos, new_capacity * sizeof(process_info_t));
+        if (grown == NULL) return;
+        shadow->infos = grown;
+        shadow->capacity = new_capacity;
+    }
+    shadow->infos[shadow->count++] = *info;
+    log_historical_stats(info);
+}
+
+/* Collect all processes from /proc into a shadow buffer, then publish it */
 void collect_all_processes(void) {
-    DIR *proc_dir;
-    struct dirent *entry;
-    pid_t pid;
-    process_info_t *info;
+    pid_t *pids = NULL;
+    int capacity = 0;
+    int live;
+    system_snapshot_t sys;
+    shadow_buffer_t shadow;
+    time_t scan_start = time(NULL);
     
     if (table == NULL) {
         table = attach_shared_memory();
@@ -170,68 +482,59 @@ void collect_all_processes(void) {
         }
     }
     
-    lock_table();
-    table->count = 0;
-    unlock_table();
-    
-    proc_dir = opendir("/proc");
-    if (proc_dir == NULL) {
-        perror("opendir /proc");
+    live = enumerate_pids(&pids, &capacity);
+    if (live < 0) {
         return;
     }
     
-    while ((entry = readdir(proc_dir)) != NULL) {
-        /* Check if entry is a process directory (numeric) */
-        if (isdigit(entry->d_name[0])) {
-            pid = (pid_t)atoi(entry->d_name);
-            
-            info = (process_info_t*)alloc_mem(sizeof(process_info_t));
-            if (info == NULL) {
-                continue;
-            }
-            
-            memset(info, 0, sizeof(process_info_t));
-            info->pid = pid;
-            info->is_zombie = 0;
-            
-            if (read_process_stat(pid, info) == 0) {
-                read_process_status(pid, info);
-                read_process_cmdline(pid, info->cmdline, sizeof(info->cmdline));
-                update_process_statistics(info);
-                
-                lock_table();
-                if (table->count < MAX_PROCESSES) {
-                    int index = table->count;
-                    update_process_info(table, index, info);
-                    table->count++;
-                    log_historical_stats(info);
-                }
-                unlock_table();
-            }
-            
-            free_mem(info);
-        }
+    shadow.capacity = live > 0 ? live : 1;
+    shadow.infos = (process_info_t*)malloc(shadow.capacity * sizeof(process_info_t));
+    shadow.count = 0;
+    if (shadow.infos == NULL) {
+        free(pids);
+        return;
     }
     
-    closedir(proc_dir);
+    read_system_snapshot(&sys);
+    
+    /* The table stays fully readable while the new contents are built */
+    scan_processes(pids, live, &sys, store_shadow_sample, &shadow);
+    publish_processes(table, shadow.infos, shadow.count, scan_start);
+    for (int i = 0; i < shadow.count; i++) {
+        watch_process(&shadow.infos[i]);
+        scheduler_track(&shadow.infos[i]);
+    }
     
-    lock_table();
-    table->last_sync = time(NULL);
-    unlock_table();
+    free(shadow.infos);
+    free(pids);
+    prune_cpu_samples(CPU_SAMPLE_MAX_AGE);
+    prune_process_strings(STRINGS_MAX_AGE);
 }
 
-/* Start process reader threads */
+/* Start process reader threads; thread_count <= 0 sizes the pool by cores */
 void start_proc_reader_threads(int thread_count) {
     if (running) {
         return;
     }
     
-    num_threads = thread_count > 0 ? thread_count : 4;
+    if (thread_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 0 ? (int)cores : 4;
+    }
+    num_threads = thread_count < READER_MAX_THREADS ? thread_count : READER_MAX_THREADS;
+    
     reader_threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
-    if (reader_threads == NULL) {
+    reader_deques = (work_deque_t*)malloc(num_threads * sizeof(work_deque_t));
+    if (reader_threads == NULL || reader_deques == NULL) {
         error_exit("Failed to allocate thread array");
     }
     
+    for (int i = 0; i < num_threads; i++) {
+        if (init_work_deque(&reader_deques[i], 64) != 0) {
+            error_exit("Failed to allocate work deque");
+        }
+    }
+    
     table = attach_shared_memory();
     if (table == NULL) {
         error_exit("Failed to attach shared memory");
@@ -241,15 +544,21 @@ void start_proc_reader_threads(int thread_count) {
     
     /* Create threads */
     for (int i = 0; i < num_threads; i++) {
-        pid_t start_pid = (pid_t)(i * 1000);
-        if (pthread_create(&reader_threads[i], NULL, read_proc_info, (void*)(long)start_pid) != 0) {
+        if (pthread_create(&reader_threads[i], NULL, read_proc_info, (void*)(long)i) != 0) {
             perror("pthread_create");
-            running = 0;
+            num_threads = i;
             break;
         }
     }
     
-    /* Also start a periodic full scan thread */
+    if (num_threads == 0 ||
+        pthread_create(&coordinator_tid, NULL, reader_coordinator, NULL) != 0) {
+        perror("pthread_create coordinator");
+        stop_proc_reader_threads();
+        return;
+    }
+    coordinator_started = 1;
+    
     log_message("Process reader threads started (%d threads)\n", num_threads);
 }
 
@@ -259,7 +568,11 @@ void stop_proc_reader_threads(void) {
         return;
     }
     
+    pthread_mutex_lock(&cycle_lock);
     running = 0;
+    pthread_cond_broadcast(&cycle_start);
+    pthread_cond_broadcast(&cycle_done);
+    pthread_mutex_unlock(&cycle_lock);
     
     /* Wait for all threads to finish */
     if (reader_threads != NULL) {
@@ -270,6 +583,16 @@ void stop_proc_reader_threads(void) {
         reader_threads = NULL;
     }
     
+    if (coordinator_started) {
+        pthread_join(coordinator_tid, NULL);
+        coordinator_started = 0;
+    }
+    
+    for (int i = 0; i < num_threads; i++) {
+        destroy_work_deque(&reader_deques[i]);
+    }
+    free(reader_deques);
+    reader_deques = NULL;
+    
     log_message("Process reader threads stopped\n");
 }
-
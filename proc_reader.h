@@ -3,11 +3,25 @@
 
 #include "common.h"
 
+/* Full-scan reader backends */
+typedef enum {
+    READER_BACKEND_SYNC,
+    READER_BACKEND_URING
+} reader_backend_t;
+
+/* Called for every process sampled by scan_processes() */
+typedef void (*sample_callback_t)(process_info_t *info, void *ctx);
+
 /* Process Reader Functions */
 void* read_proc_info(void *arg);
-int read_process_stat(pid_t pid, process_info_t *info);
-int read_process_status(pid_t pid, process_info_t *info);
-int read_process_cmdline(pid_t pid, char *cmdline, size_t max_len);
+int parse_process_stat(char *buf, const system_snapshot_t *sys, process_info_t *info);
+int read_process_stat(pid_t pid, const system_snapshot_t *sys, process_info_t *info);
+int sample_process(pid_t pid, const system_snapshot_t *sys, process_info_t *info);
+int enumerate_pids(pid_t **pids, int *capacity);
+int set_reader_backend(reader_backend_t backend);
+reader_backend_t get_reader_backend(void);
+int scan_processes(const pid_t *pids, int count, const system_snapshot_t *sys,
+                   sample_callback_t callback, void *ctx);
 void collect_all_processes(void);
 void start_proc_reader_threads(int num_threads);
 void stop_proc_reader_threads(void);
@@ -1,95 +1,459 @@
 #include "process_table.h"
 #include "logger.h"
+#include "string_arena.h"
+#include <sched.h>
+#include <sys/stat.h>
 
-static int shm_id = -1;
-static int sem_id = -1;
+static int shm_fd = -1;
 static process_table_t *shared_table = NULL;
+static size_t mapped_size = 0;        /* Bytes of the segment mapped here */
+static size_t reserved_size = 0;      /* Address space reserved for the largest table */
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static int requested_max_capacity = 0;
 
-/* Initialize semaphores */
-int init_semaphores(void) {
-    sem_id = semget(SEM_KEY, 1, IPC_CREAT | 0666);
-    if (sem_id == -1) {
-        perror("semget");
-        return -1;
+static void index_rebuild(process_table_t *table);
+static void rebuild_free_list(process_table_t *table);
+static void sync_mapping(process_table_t *table);
+
+/* Add to a lock counter shared with other processes */
+static void count_lock_stat(unsigned long long *counter, unsigned long long n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+/* CLOCK_MONOTONIC time in nanoseconds (vDSO, no syscall) */
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/* Raise a shared maximum to value if it is larger */
+static void raise_lock_max(unsigned long long *max_field, unsigned long long value) {
+    unsigned long long max = __atomic_load_n(max_field, __ATOMIC_RELAXED);
+    
+    while (value > max &&
+           !__atomic_compare_exchange_n(max_field, &max, value, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
     }
+}
+
+/* Account one hold of a lock taken at since (called by the holder before unlocking) */
+static void count_lock_hold(lock_stats_t *stats, unsigned long long since) {
+    unsigned long long held = now_ns() - since;
     
-    /* Set initial semaphore value to 1 (binary semaphore for mutual exclusion) */
-    semctl(sem_id, 0, SETVAL, 1);
-    log_message("Semaphores initialized\n");
-    return 0;
+    count_lock_stat(&stats->hold_ns, held);
+    raise_lock_max(&stats->max_hold_ns, held);
 }
 
-/* Destroy semaphores */
-void destroy_semaphores(void) {
-    if (sem_id != -1) {
-        semctl(sem_id, 0, IPC_RMID, 0);
-        sem_id = -1;
-        log_message("Semaphores destroyed\n");
+/*
+ * Acquire a shared mutex. The uncontended path is a single trylock with no
+ * syscall; only a waiter is timed. Returns 1 if the previous holder died
+ * with the lock held (the mutex is made consistent again), 0 otherwise.
+ */
+static int acquire_lock(pthread_mutex_t *lock, lock_stats_t *stats) {
+    struct timespec start, end;
+    int rc = pthread_mutex_trylock(lock);
+    
+    if (rc == EBUSY) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        rc = pthread_mutex_lock(lock);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        unsigned long long waited = (unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+                                    (unsigned long long)(end.tv_nsec - start.tv_nsec);
+        
+        count_lock_stat(&stats->contended, 1);
+        count_lock_stat(&stats->wait_ns, waited);
+        raise_lock_max(&stats->max_wait_ns, waited);
     }
+    count_lock_stat(&stats->acquisitions, 1);
+    
+    if (rc == EOWNERDEAD) {
+        pthread_mutex_consistent(lock);
+        count_lock_stat(&stats->owner_died, 1);
+        log_message("Recovered table lock from a dead holder\n");
+        return 1;
+    }
+    if (rc != 0) {
+        log_message("Table lock failed: %s\n", strerror(rc));
+    }
+    return 0;
 }
 
-/* Lock the process table */
+/* Initialize a process-shared, robust mutex in the segment */
+static void init_shared_lock(pthread_mutex_t *lock) {
+    pthread_mutexattr_t attr;
+    
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* Shard guarding a slot: fixed ranges dealt round-robin, independent of capacity */
+int shard_of_slot(int slot) {
+    return (slot / SHARD_SLOTS) % TABLE_SHARDS;
+}
+
+/*
+ * Lock the whole table for structural changes (insert, remove, slot moves).
+ * Takes the structural lock, then every shard in ascending order.
+ */
 void lock_table(void) {
-    struct sembuf op;
-    op.sem_num = 0;
-    op.sem_op = -1;  /* Decrement (wait) */
-    op.sem_flg = SEM_UNDO;
+    process_table_t *table = shared_table;
+    int owner_died;
+    
+    if (table == NULL) return;
     
-    if (semop(sem_id, &op, 1) == -1) {
-        perror("semop lock");
+    owner_died = acquire_lock(&table->lock, &table->table_lock_stats);
+    for (int s = 0; s < TABLE_SHARDS; s++) {
+        acquire_lock(&table->shards[s].lock, &table->shard_lock_stats);
+    }
+    
+    /* Holds are timed from here: every lock is blocked for the whole change */
+    table->held_since_ns = now_ns();
+    
+    /* Odd sequence: snapshot readers retry until we are done (a dead holder may have left it odd) */
+    __atomic_store_n(&table->seq, (table->seq + 1) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    sync_mapping(table);
+    
+    /* A holder died mid-change: the index may not match the entries */
+    if (owner_died) {
+        if (table->count < 0) table->count = 0;
+        if (table->count > table->capacity) table->count = table->capacity;
+        index_rebuild(table);
+        rebuild_free_list(table);
     }
 }
 
-/* Unlock the process table */
+/* Unlock the whole table */
 void unlock_table(void) {
-    struct sembuf op;
-    op.sem_num = 0;
-    op.sem_op = 1;   /* Increment (signal) */
-    op.sem_flg = SEM_UNDO;
+    process_table_t *table = shared_table;
+    
+    if (table == NULL) return;
+    
+    __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+    
+    unsigned long long held = now_ns() - table->held_since_ns;
+    count_lock_stat(&table->table_lock_stats.hold_ns, held);
+    raise_lock_max(&table->table_lock_stats.max_hold_ns, held);
+    count_lock_stat(&table->shard_lock_stats.hold_ns, held * TABLE_SHARDS);
+    raise_lock_max(&table->shard_lock_stats.max_hold_ns, held);
+    
+    for (int s = TABLE_SHARDS - 1; s >= 0; s--) {
+        pthread_mutex_unlock(&table->shards[s].lock);
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+/* Lock only the structural lock, for lookups in the index */
+void lock_index(void) {
+    if (shared_table == NULL) return;
+    
+    int owner_died = acquire_lock(&shared_table->lock, &shared_table->table_lock_stats);
+    
+    shared_table->held_since_ns = now_ns();
+    sync_mapping(shared_table);
+    if (owner_died) {
+        __atomic_store_n(&shared_table->seq, (shared_table->seq + 1) | 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        index_rebuild(shared_table);
+        __atomic_store_n(&shared_table->seq, shared_table->seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Unlock the structural lock */
+void unlock_index(void) {
+    if (shared_table == NULL) return;
+    
+    count_lock_hold(&shared_table->table_lock_stats, shared_table->held_since_ns);
+    pthread_mutex_unlock(&shared_table->lock);
+}
+
+/* Lock one slot range for in-place writes; entries in it cannot move */
+void lock_shard(int shard) {
+    table_shard_t *s;
+    
+    if (shared_table == NULL || shard < 0 || shard >= TABLE_SHARDS) return;
     
-    if (semop(sem_id, &op, 1) == -1) {
-        perror("semop unlock");
+    s = &shared_table->shards[shard];
+    acquire_lock(&s->lock, &shared_table->shard_lock_stats);
+    s->held_since_ns = now_ns();
+    sync_mapping(shared_table);
+    
+    __atomic_store_n(&s->seq, (s->seq + 1) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Unlock one slot range */
+void unlock_shard(int shard) {
+    table_shard_t *s;
+    
+    if (shared_table == NULL || shard < 0 || shard >= TABLE_SHARDS) return;
+    
+    s = &shared_table->shards[shard];
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+    count_lock_hold(&shared_table->shard_lock_stats, s->held_since_ns);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Copy the lock wait counters */
+void get_lock_stats(process_table_t *table, lock_stats_t *table_stats, lock_stats_t *shard_stats) {
+    const lock_stats_t *src[2];
+    lock_stats_t *dst[2] = { table_stats, shard_stats };
+    
+    if (table == NULL) return;
+    
+    src[0] = &table->table_lock_stats;
+    src[1] = &table->shard_lock_stats;
+    
+    for (int i = 0; i < 2; i++) {
+        if (dst[i] == NULL) continue;
+        dst[i]->acquisitions = __atomic_load_n(&src[i]->acquisitions, __ATOMIC_RELAXED);
+        dst[i]->contended = __atomic_load_n(&src[i]->contended, __ATOMIC_RELAXED);
+        dst[i]->wait_ns = __atomic_load_n(&src[i]->wait_ns, __ATOMIC_RELAXED);
+        dst[i]->max_wait_ns = __atomic_load_n(&src[i]->max_wait_ns, __ATOMIC_RELAXED);
+        dst[i]->hold_ns = __atomic_load_n(&src[i]->hold_ns, __ATOMIC_RELAXED);
+        dst[i]->max_hold_ns = __atomic_load_n(&src[i]->max_hold_ns, __ATOMIC_RELAXED);
+        dst[i]->owner_died = __atomic_load_n(&src[i]->owner_died, __ATOMIC_RELAXED);
     }
 }
 
+/* Element size of each column */
+static const size_t column_sizes[TABLE_COLUMNS] = {
+    sizeof(pid_t),              /* COL_PID */
+    sizeof(pid_t),              /* COL_PPID */
+    sizeof(proc_state_t),       /* COL_STATE */
+    sizeof(unsigned long),      /* COL_UTIME */
+    sizeof(unsigned long),      /* COL_STIME */
+    sizeof(long),               /* COL_RSS */
+    sizeof(double),             /* COL_CPU_PERCENT */
+    sizeof(double),             /* COL_MEM_PERCENT */
+    sizeof(time_t),             /* COL_LAST_UPDATE */
+    sizeof(unsigned char),      /* COL_DIRTY */
+    sizeof(process_cold_t),     /* COL_COLD */
+    sizeof(int),                /* COL_FREE */
+    sizeof(pid_index_entry_t)   /* COL_INDEX */
+};
+
+/* Column array of a table laid out with offs */
+#define COLUMN(table, offs, col, type) ((type*)((char*)(table) + (offs)[col]))
+#define TABLE_COL(table, col, type) COLUMN(table, (table)->offsets, col, type)
+
+/* Round up to a multiple of align (a power of two) */
+static size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+}
+
+/* Round up to whole pages */
+static size_t page_round(size_t n) {
+    return round_up(n, (size_t)sysconf(_SC_PAGESIZE));
+}
+
+/* Index buckets for a capacity: a power of two at least twice as large */
+static int index_size_for(int capacity) {
+    int size = 2;
+    
+    while (size < capacity * 2) {
+        size *= 2;
+    }
+    return size;
+}
+
+/* Lay the columns out after the header (each cache-line aligned); returns the total size */
+static size_t layout_table(int capacity, int index_size, size_t *offsets) {
+    size_t offset = round_up(sizeof(process_table_t), 64);
+    
+    for (int col = 0; col < TABLE_COLUMNS; col++) {
+        size_t entries = col == COL_INDEX ? (size_t)index_size : (size_t)capacity;
+        
+        offsets[col] = offset;
+        offset += round_up(entries * column_sizes[col], 64);
+    }
+    return offset;
+}
+
+/* Bound applied when this process creates the segment */
+void set_table_max_capacity(int max_capacity) {
+    if (max_capacity > 0) {
+        requested_max_capacity = max_capacity;
+    }
+}
+
+/* Configured bound: set_table_max_capacity(), then PSX_MAX_PROCESSES, then the default */
+static int configured_max_capacity(void) {
+    const char *env = getenv("PSX_MAX_PROCESSES");
+    
+    if (requested_max_capacity > 0) {
+        return requested_max_capacity;
+    }
+    if (env != NULL && atoi(env) > 0) {
+        return atoi(env);
+    }
+    return TABLE_DEFAULT_MAX_CAPACITY;
+}
+
+/*
+ * Make sure this process maps the first size bytes of the segment. Only the
+ * new tail is mapped, inside the reservation, so the table never moves.
+ */
+static int map_to(size_t size) {
+    int result = 0;
+    
+    if (size <= __atomic_load_n(&mapped_size, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&map_lock);
+    
+    size = page_round(size);
+    if (size > mapped_size) {
+        if (size > reserved_size ||
+            mmap((char*)shared_table + mapped_size, size - mapped_size,
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 shm_fd, (off_t)mapped_size) == MAP_FAILED) {
+            log_message("Failed to extend table mapping to %zu bytes\n", size);
+            result = -1;
+        } else {
+            __atomic_store_n(&mapped_size, size, __ATOMIC_RELEASE);
+        }
+    }
+    
+    pthread_mutex_unlock(&map_lock);
+    return result;
+}
+
+/* Follow growth by another process (called with a table lock held) */
+static void sync_mapping(process_table_t *table) {
+    map_to(table->size);
+}
+
 /* Attach to shared memory */
 process_table_t* attach_shared_memory(void) {
+    process_table_t *table;
+    size_t offsets[TABLE_COLUMNS];
+    size_t size, reserve;
+    int max_capacity, capacity;
+    int created = 0;
+    
     if (shared_table != NULL) {
         return shared_table;
     }
     
-    /* Create or get shared memory segment */
-    shm_id = shmget(SHM_KEY, sizeof(process_table_t), IPC_CREAT | 0666);
-    if (shm_id == -1) {
-        perror("shmget");
+    /* Create or open the segment */
+    shm_fd = shm_open(TABLE_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (shm_fd != -1) {
+        created = 1;
+        fchmod(shm_fd, 0666);
+    } else if (errno == EEXIST) {
+        shm_fd = shm_open(TABLE_SHM_NAME, O_RDWR, 0);
+    }
+    if (shm_fd == -1) {
+        perror("shm_open");
         return NULL;
     }
     
-    /* Attach to shared memory */
-    shared_table = (process_table_t*)shmat(shm_id, NULL, 0);
-    if (shared_table == (void*)-1) {
-        perror("shmat");
-        shared_table = NULL;
-        return NULL;
+    /* Entry strings live in their own object; a new table starts a new arena */
+    if (attach_string_arena(created) == -1) {
+        goto fail;
     }
     
-    /* Initialize if first time */
-    if (shared_table->active == 0) {
-        shared_table->count = 0;
-        shared_table->last_sync = time(NULL);
-        shared_table->active = 1;
-        memset(shared_table->processes, 0, sizeof(shared_table->processes));
+    if (created) {
+        max_capacity = configured_max_capacity();
+        capacity = TABLE_INITIAL_CAPACITY < max_capacity ? TABLE_INITIAL_CAPACITY : max_capacity;
+        size = layout_table(capacity, index_size_for(capacity), offsets);
+        
+        if (ftruncate(shm_fd, (off_t)page_round(size)) == -1) {
+            perror("ftruncate");
+            goto fail;
+        }
+    } else {
+        /* Wait for the creator, then read the bound that sizes the reservation */
+        process_table_t *header = MAP_FAILED;
+        struct stat st;
+        int waited = 0;
+        
+        while (fstat(shm_fd, &st) == 0 && (size_t)st.st_size < sizeof(process_table_t) && waited++ < 2000) {
+            usleep(1000);
+        }
+        if ((size_t)st.st_size >= sizeof(process_table_t)) {
+            header = (process_table_t*)mmap(NULL, sizeof(process_table_t), PROT_READ, MAP_SHARED, shm_fd, 0);
+        }
+        if (header == MAP_FAILED) {
+            log_message("Process table segment is not initialized\n");
+            goto fail;
+        }
+        while (__atomic_load_n(&header->active, __ATOMIC_ACQUIRE) != 1 && waited++ < 2000) {
+            usleep(1000);
+        }
+        max_capacity = header->max_capacity;
+        size = header->size;
+        waited = __atomic_load_n(&header->active, __ATOMIC_ACQUIRE) == 1;
+        munmap(header, sizeof(process_table_t));
+        
+        if (!waited || max_capacity <= 0) {
+            log_message("Process table segment is not initialized\n");
+            goto fail;
+        }
     }
     
+    /* Reserve address space for the largest table; map what exists now */
+    reserve = page_round(layout_table(max_capacity, index_size_for(max_capacity), offsets));
+    table = (process_table_t*)mmap(NULL, reserve, PROT_NONE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (table == MAP_FAILED) {
+        perror("mmap reserve");
+        goto fail;
+    }
+    if (mmap(table, page_round(size), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shm_fd, 0) == MAP_FAILED) {
+        perror("mmap");
+        munmap(table, reserve);
+        goto fail;
+    }
+    reserved_size = reserve;
+    mapped_size = page_round(size);
+    
+    /* Initialize if first time (the new file is zero-filled) */
+    if (created) {
+        table->count = 0;
+        table->capacity = capacity;
+        table->max_capacity = max_capacity;
+        table->index_size = index_size_for(capacity);
+        table->generation = 0;
+        table->size = layout_table(capacity, table->index_size, table->offsets);
+        table->last_sync = time(NULL);
+        
+        init_shared_lock(&table->lock);
+        for (int s = 0; s < TABLE_SHARDS; s++) {
+            init_shared_lock(&table->shards[s].lock);
+        }
+        __atomic_store_n(&table->active, 1, __ATOMIC_RELEASE);
+    }
+    
+    shared_table = table;
     log_message("Shared memory attached\n");
     return shared_table;
+
+fail:
+    detach_string_arena();
+    close(shm_fd);
+    shm_fd = -1;
+    return NULL;
 }
 
 /* Detach from shared memory */
 void detach_shared_memory(process_table_t *table) {
     if (table != NULL && table == shared_table) {
-        shmdt(table);
+        munmap(shared_table, reserved_size);
+        close(shm_fd);
+        shm_fd = -1;
         shared_table = NULL;
+        mapped_size = reserved_size = 0;
+        detach_string_arena();
         log_message("Shared memory detached\n");
     }
 }
@@ -97,27 +461,374 @@ void detach_shared_memory(process_table_t *table) {
 /* Destroy shared memory */
 void destroy_shared_memory(void) {
     if (shared_table != NULL) {
-        shmdt(shared_table);
-        shared_table = NULL;
+        detach_shared_memory(shared_table);
     }
     
-    if (shm_id != -1) {
-        shmctl(shm_id, IPC_RMID, NULL);
-        shm_id = -1;
+    destroy_string_arena();
+    if (shm_unlink(TABLE_SHM_NAME) == 0) {
         log_message("Shared memory destroyed\n");
     }
 }
 
-/* Find process index by PID */
-int find_process_index(process_table_t *table, pid_t pid) {
-    if (table == NULL) return -1;
+/* Gather the fields of one entry but not its strings (only their references) */
+static void gather_fields(const process_table_t *table, const size_t *offs, int slot, process_info_t *out) {
+    const process_cold_t *cold = &COLUMN(table, offs, COL_COLD, const process_cold_t)[slot];
+    
+    out->pid = COLUMN(table, offs, COL_PID, const pid_t)[slot];
+    out->ppid = COLUMN(table, offs, COL_PPID, const pid_t)[slot];
+    out->name_ref = cold->name;
+    out->cmdline_ref = cold->cmdline;
+    out->cmdline_stamp = arena_stamp(cold->cmdline);
+    out->state = COLUMN(table, offs, COL_STATE, const proc_state_t)[slot];
+    out->utime = COLUMN(table, offs, COL_UTIME, const unsigned long)[slot];
+    out->stime = COLUMN(table, offs, COL_STIME, const unsigned long)[slot];
+    out->starttime = cold->starttime;
+    out->vsize = cold->vsize;
+    out->uid = cold->uid;
+    out->rss = COLUMN(table, offs, COL_RSS, const long)[slot];
+    out->cpu_percent = COLUMN(table, offs, COL_CPU_PERCENT, const double)[slot];
+    out->mem_percent = COLUMN(table, offs, COL_MEM_PERCENT, const double)[slot];
+    out->last_update = COLUMN(table, offs, COL_LAST_UPDATE, const time_t)[slot];
+    out->is_zombie = cold->is_zombie;
+    out->dirty = COLUMN(table, offs, COL_DIRTY, const unsigned char)[slot];
+}
+
+/* Gather one entry of a table laid out with offs */
+static void gather_entry(const process_table_t *table, const size_t *offs, int slot, process_info_t *out) {
+    gather_fields(table, offs, slot, out);
+    arena_copy(out->name_ref, out->name, sizeof(out->name));
+    arena_copy(out->cmdline_ref, out->cmdline, sizeof(out->cmdline));
+}
+
+/* Gather one entry from the hot columns and its cold record */
+void table_get_info(const process_table_t *table, int slot, process_info_t *out) {
+    gather_entry(table, table->offsets, slot, out);
+}
+
+/* Point a cold string field at a held reference, dropping the one it had */
+static void assign_string(arena_ref_t *field, arena_ref_t ref) {
+    arena_ref_t old = *field;
+    
+    *field = ref;
+    arena_release(old);
+}
+
+/*
+ * Scatter one entry into the hot columns and its cold record. Strings are
+ * interned only when they changed: the name is compared in place, and the
+ * cmdline the cache already interned is shared by taking a reference.
+ */
+void table_set_info(process_table_t *table, int slot, const process_info_t *info) {
+    process_cold_t *cold = &TABLE_COL(table, COL_COLD, process_cold_t)[slot];
+    
+    TABLE_COL(table, COL_PID, pid_t)[slot] = info->pid;
+    TABLE_COL(table, COL_PPID, pid_t)[slot] = info->ppid;
+    TABLE_COL(table, COL_STATE, proc_state_t)[slot] = info->state;
+    TABLE_COL(table, COL_UTIME, unsigned long)[slot] = info->utime;
+    TABLE_COL(table, COL_STIME, unsigned long)[slot] = info->stime;
+    TABLE_COL(table, COL_RSS, long)[slot] = info->rss;
+    TABLE_COL(table, COL_CPU_PERCENT, double)[slot] = info->cpu_percent;
+    TABLE_COL(table, COL_MEM_PERCENT, double)[slot] = info->mem_percent;
+    TABLE_COL(table, COL_LAST_UPDATE, time_t)[slot] = info->last_update;
+    TABLE_COL(table, COL_DIRTY, unsigned char)[slot] = (unsigned char)info->dirty;
+    if (!arena_equals(cold->name, info->name)) {
+        assign_string(&cold->name, arena_intern(info->name, strnlen(info->name, sizeof(info->name)), NULL));
+    }
+    if (cold->cmdline == 0 || info->cmdline_ref != cold->cmdline) {
+        if (info->cmdline_ref != 0 && arena_retain(info->cmdline_ref, info->cmdline_stamp) == 0) {
+            assign_string(&cold->cmdline, info->cmdline_ref);
+        } else if (!arena_equals(cold->cmdline, info->cmdline)) {
+            assign_string(&cold->cmdline, arena_intern(info->cmdline, strnlen(info->cmdline, sizeof(info->cmdline)), NULL));
+        }
+    }
+    cold->starttime = info->starttime;
+    cold->vsize = info->vsize;
+    cold->uid = info->uid;
+    cold->is_zombie = info->is_zombie;
+}
+
+/* Hot column getters for sweeps that do not need the whole entry */
+pid_t table_pid(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_PID, const pid_t)[slot];
+}
+
+pid_t table_ppid(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_PPID, const pid_t)[slot];
+}
+
+proc_state_t table_state(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_STATE, const proc_state_t)[slot];
+}
+
+double table_cpu_percent(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_CPU_PERCENT, const double)[slot];
+}
+
+time_t table_last_update(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_LAST_UPDATE, const time_t)[slot];
+}
+
+int table_dirty(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_DIRTY, const unsigned char)[slot];
+}
+
+/* Interned name: entries with equal names have equal references */
+arena_ref_t table_name_ref(const process_table_t *table, int slot) {
+    return TABLE_COL(table, COL_COLD, const process_cold_t)[slot].name;
+}
+
+/* Empty a slot's cold record before first use (growth leaves stale bytes) */
+static void clear_cold(process_table_t *table, int slot) {
+    memset(&TABLE_COL(table, COL_COLD, process_cold_t)[slot], 0, sizeof(process_cold_t));
+}
+
+/* Home bucket of a PID in an index of size buckets */
+static int index_home(pid_t pid, int size) {
+    return (int)(((unsigned)pid * 2654435761u) & (unsigned)(size - 1));
+}
+
+/* Bucket holding pid, or the empty bucket where it would go */
+static int index_probe(const pid_index_entry_t *index, int size, pid_t pid) {
+    int i = index_home(pid, size);
+    
+    /* Bounded so a reader racing a rebuild cannot spin */
+    for (int n = 0; n < size && index[i].pid != 0 && index[i].pid != pid; n++) {
+        i = (i + 1) & (size - 1);
+    }
+    return i;
+}
+
+/* Point pid at slot (caller holds the lock) */
+static void index_set(process_table_t *table, pid_t pid, int slot) {
+    pid_index_entry_t *index = TABLE_COL(table, COL_INDEX, pid_index_entry_t);
+    int i = index_probe(index, table->index_size, pid);
+    
+    index[i].pid = pid;
+    index[i].slot = slot;
+}
+
+/* Remove pid from the index, shifting back later entries of its probe run */
+static void index_remove(process_table_t *table, pid_t pid) {
+    pid_index_entry_t *index = TABLE_COL(table, COL_INDEX, pid_index_entry_t);
+    const int mask = table->index_size - 1;
+    int hole = index_probe(index, table->index_size, pid);
+    int i = hole;
+    
+    if (index[hole].pid != pid) return;
+    
+    for (;;) {
+        i = (i + 1) & mask;
+        if (index[i].pid == 0) break;
+        
+        int home = index_home(index[i].pid, table->index_size);
+        /* Move i into the hole unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index[hole] = index[i];
+            hole = i;
+        }
+    }
+    index[hole].pid = 0;
+}
+
+/* Rebuild the index from the entries (caller holds the lock) */
+static void index_rebuild(process_table_t *table) {
+    const pid_t *pids = TABLE_COL(table, COL_PID, const pid_t);
+    
+    memset(TABLE_COL(table, COL_INDEX, pid_index_entry_t), 0,
+           (size_t)table->index_size * sizeof(pid_index_entry_t));
+    for (int i = 0; i < table->count; i++) {
+        if (pids[i] != 0) {
+            index_set(table, pids[i], i);
+        }
+    }
+}
+
+/*
+ * Grow the columns to hold at least 'needed' slots, doubling up to the
+ * configured bound (caller holds the table lock). The file is extended and
+ * mapped first; every column then moves up to its new offset, last column
+ * first so no column overwrites one not yet moved. Slot numbers stay valid.
+ */
+static int grow_table(process_table_t *table, int needed) {
+    size_t offsets[TABLE_COLUMNS];
+    int capacity = table->capacity;
+    int index_size;
+    size_t size;
+    
+    if (needed <= capacity) return 0;
+    if (needed > table->max_capacity) return -1;
+    
+    while (capacity < needed) {
+        capacity = capacity > table->max_capacity / 2 ? table->max_capacity : capacity * 2;
+    }
+    index_size = index_size_for(capacity);
+    size = layout_table(capacity, index_size, offsets);
+    
+    if (ftruncate(shm_fd, (off_t)page_round(size)) == -1 || map_to(size) == -1) {
+        log_message("Failed to grow process table to %d slots: %s\n", capacity, strerror(errno));
+        return -1;
+    }
+    
+    for (int col = COL_INDEX - 1; col >= 0; col--) {
+        memmove((char*)table + offsets[col], (char*)table + table->offsets[col],
+                (size_t)table->capacity * column_sizes[col]);
+    }
+    
+    memcpy(table->offsets, offsets, sizeof(offsets));
+    table->capacity = capacity;
+    table->index_size = index_size;
+    table->size = size;
+    table->generation++;
+    index_rebuild(table);
+    
+    log_message("Process table grown to %d slots (%zu KB)\n", capacity, size / 1024);
+    return 0;
+}
+
+/* Whether slot can take one more entry, growing the table if needed */
+static int has_room(process_table_t *table, int slot) {
+    return slot < table->capacity || grow_table(table, slot + 1) == 0;
+}
+
+/* Push a slot on the free min-heap */
+static void free_push(process_table_t *table, int slot) {
+    int *heap = TABLE_COL(table, COL_FREE, int);
+    int i = table->free_count++;
     
+    while (i > 0 && heap[(i - 1) / 2] > slot) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = slot;
+}
+
+/* Pop the lowest slot from the free min-heap (free_count > 0) */
+static int free_pop(process_table_t *table) {
+    int *heap = TABLE_COL(table, COL_FREE, int);
+    int top = heap[0];
+    int last = heap[--table->free_count];
+    int n = table->free_count;
+    int i = 0;
+    
+    for (;;) {
+        int child = 2 * i + 1;
+        
+        if (child >= n) break;
+        if (child + 1 < n && heap[child + 1] < heap[child]) child++;
+        if (heap[child] >= last) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (n > 0) heap[i] = last;
+    return top;
+}
+
+/* Recount live entries and re-add every tombstone (caller holds the lock) */
+static void rebuild_free_list(process_table_t *table) {
+    const pid_t *pids = TABLE_COL(table, COL_PID, const pid_t);
+    int *heap = TABLE_COL(table, COL_FREE, int);
+    
+    /* Ascending order is already a valid min-heap */
+    table->live = 0;
+    table->free_count = 0;
     for (int i = 0; i < table->count; i++) {
-        if (table->processes[i].pid == pid) {
-            return i;
+        if (pids[i] != 0) {
+            table->live++;
+        } else {
+            heap[table->free_count++] = i;
         }
     }
-    return -1;
+}
+
+/*
+ * Turn a live slot into a tombstone: unindex it, clear the PID and push the
+ * slot on the free heap, O(log n) on ints instead of shifting every later
+ * entry (caller holds the lock).
+ */
+static void tombstone_slot(process_table_t *table, int slot) {
+    pid_t pid = table_pid(table, slot);
+    
+    if (pid == 0) return;
+    
+    index_remove(table, pid);
+    TABLE_COL(table, COL_PID, pid_t)[slot] = 0;
+    TABLE_COL(table, COL_DIRTY, unsigned char)[slot] = 0;
+    assign_string(&TABLE_COL(table, COL_COLD, process_cold_t)[slot].name, 0);
+    assign_string(&TABLE_COL(table, COL_COLD, process_cold_t)[slot].cmdline, 0);
+    table->live--;
+    
+    if (slot == table->count - 1) {
+        table->count--;
+    } else if (table->free_count < table->capacity) {
+        free_push(table, slot);
+    } else {
+        /* Stale duplicates filled the heap: rebuild it from the entries */
+        rebuild_free_list(table);
+    }
+}
+
+/*
+ * Slot for a new entry: the lowest tombstone, so live entries gather at the
+ * front and compaction can trim the tail, else one past the end (growing the
+ * table if needed). Heap entries at or past count, or already reused, are
+ * stale and skipped. Returns -1 when the table is full.
+ */
+static int take_slot(process_table_t *table) {
+    while (table->free_count > 0) {
+        int slot = free_pop(table);
+        
+        if (slot < table->count && table_pid(table, slot) == 0) return slot;
+    }
+    
+    if (!has_room(table, table->count)) return -1;
+    clear_cold(table, table->count);
+    return table->count++;
+}
+
+/* Insert info into a free slot (caller holds the lock); returns the slot or -1 */
+static int insert_entry(process_table_t *table, const process_info_t *info) {
+    int slot = take_slot(table);
+    
+    if (slot >= 0) {
+        table_set_info(table, slot, info);
+        index_set(table, info->pid, slot);
+        table->live++;
+    }
+    return slot;
+}
+
+/*
+ * Background compaction step: trim up to budget trailing tombstones so
+ * scans stop at the last live entry. Live entries never move. Returns the
+ * number of slots trimmed.
+ */
+int compact_table(process_table_t *table, int budget) {
+    int trimmed = 0;
+    
+    if (table == NULL) return 0;
+    
+    lock_table();
+    
+    while (table->count > 0 && trimmed < budget && table_pid(table, table->count - 1) == 0) {
+        table->count--;
+        trimmed++;
+    }
+    /* Nothing left to reuse: drop stale stack entries too */
+    if (table->live == table->count) {
+        table->free_count = 0;
+    }
+    
+    unlock_table();
+    return trimmed;
+}
+
+/* Find process index by PID (O(1) through the shared hash index) */
+int find_process_index(process_table_t *table, pid_t pid) {
+    if (table == NULL || pid <= 0) return -1;
+    
+    const pid_index_entry_t *index = TABLE_COL(table, COL_INDEX, const pid_index_entry_t);
+    int i = index_probe(index, table->index_size, pid);
+    return index[i].pid == pid ? index[i].slot : -1;
 }
 
 /* Update process information */
@@ -126,18 +837,191 @@ void update_process_info(process_table_t *table, int index, process_info_t *info
     
     lock_table();
     
-    if (index >= 0 && index < MAX_PROCESSES) {
-        if (index >= table->count) {
-            table->count = index + 1;
+    if (index >= 0 && has_room(table, index)) {
+        /* Slots skipped over by extending count become tombstones */
+        while (table->count <= index) {
+            TABLE_COL(table, COL_PID, pid_t)[table->count] = 0;
+            clear_cold(table, table->count);
+            if (table->count < index && table->free_count < table->capacity) {
+                free_push(table, table->count);
+            }
+            table->count++;
+        }
+        
+        if (table_pid(table, index) != info->pid) {
+            tombstone_slot(table, index);
+            if (table->count <= index) {
+                table->count = index + 1;
+            }
+            if (info->pid != 0) {
+                index_set(table, info->pid, index);
+                table->live++;
+            }
         }
-        memcpy(&table->processes[index], info, sizeof(process_info_t));
+        table_set_info(table, index, info);
+        table->last_sync = time(NULL);
+    }
+    
+    unlock_table();
+}
+
+/*
+ * Find the entry of pid and lock its shard. The slot is looked up under the
+ * structural lock and re-checked once the shard is held, since a structural
+ * writer may have moved it in between. Returns the slot (release it with
+ * unlock_entry()), or -1 with nothing held if the PID is not in the table.
+ */
+static int lock_entry(process_table_t *table, pid_t pid) {
+    for (;;) {
+        int index, shard;
+        
+        lock_index();
+        index = find_process_index(table, pid);
+        unlock_index();
+        
+        if (index < 0) return -1;
+        
+        shard = shard_of_slot(index);
+        lock_shard(shard);
+        if (index < table->count && table_pid(table, index) == pid) return index;
+        unlock_shard(shard);
+    }
+}
+
+/* Release the shard taken by lock_entry() */
+static void unlock_entry(int index) {
+    unlock_shard(shard_of_slot(index));
+}
+
+/* Write info over the existing entry of its PID; -1 if not in the table */
+static int write_existing(process_table_t *table, process_info_t *info) {
+    int index = lock_entry(table, info->pid);
+    
+    if (index >= 0) {
+        table_set_info(table, index, info);
+        __atomic_store_n(&table->last_sync, time(NULL), __ATOMIC_RELAXED);
+        unlock_entry(index);
+    }
+    return index;
+}
+
+/* Insert a process or refresh its existing entry; returns its index */
+int upsert_process(process_table_t *table, process_info_t *info) {
+    int index;
+    
+    if (table == NULL || info == NULL) return -1;
+    
+    index = write_existing(table, info);
+    if (index >= 0) return index;
+    
+    lock_table();
+    
+    index = find_process_index(table, info->pid);
+    if (index >= 0) {
+        table_set_info(table, index, info);
+    } else {
+        index = insert_entry(table, info);
+    }
+    
+    if (index >= 0) {
         table->last_sync = time(NULL);
     }
     
     unlock_table();
+    return index;
 }
 
-/* Remove process from table */
+/* Refresh an existing entry only; returns -1 if the PID is not in the table */
+int replace_process(process_table_t *table, process_info_t *info) {
+    if (table == NULL || info == NULL) return -1;
+    
+    return write_existing(table, info);
+}
+
+/*
+ * Store a batch of samples taken without any lock. Slots are looked up in
+ * one structural section, then each shard the batch touches is taken once
+ * for all of its entries; with insert set, PIDs not in the table are added
+ * in one more structural section. An entry whose start time differs from
+ * the sample's belongs to another process that reused the PID; it is
+ * treated as removed, and only an insert replaces it, with the process
+ * that started later. A dirty flag raised after sampling is kept.
+ * slots[i] receives the slot of infos[i], or -1 if it was not stored.
+ * Returns the number of entries stored.
+ */
+int commit_processes(process_table_t *table, const process_info_t *infos, int count, int insert, int *slots) {
+    unsigned int shards = 0;
+    int stored = 0;
+    int missing = 0;
+    
+    if (table == NULL || infos == NULL || count <= 0) return 0;
+    
+    lock_index();
+    for (int i = 0; i < count; i++) {
+        slots[i] = find_process_index(table, infos[i].pid);
+        if (slots[i] >= 0) shards |= 1u << shard_of_slot(slots[i]);
+    }
+    unlock_index();
+    
+    for (int s = 0; s < TABLE_SHARDS; s++) {
+        if (!(shards & (1u << s))) continue;
+        
+        lock_shard(s);
+        
+        unsigned char *dirty = TABLE_COL(table, COL_DIRTY, unsigned char);
+        process_cold_t *cold = TABLE_COL(table, COL_COLD, process_cold_t);
+        for (int i = 0; i < count; i++) {
+            int slot = slots[i];
+            if (slot < 0 || shard_of_slot(slot) != s) continue;
+            
+            /* Removed, or the PID reused, between sampling and the shard lock */
+            if (slot >= table->count || table_pid(table, slot) != infos[i].pid ||
+                cold[slot].starttime != infos[i].starttime) {
+                slots[i] = -1;
+                continue;
+            }
+            
+            unsigned char pending = dirty[slot];
+            table_set_info(table, slot, &infos[i]);
+            dirty[slot] |= pending;
+            stored++;
+        }
+        
+        unlock_shard(s);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (slots[i] < 0) missing++;
+    }
+    
+    if (missing > 0 && insert) {
+        lock_table();
+        for (int i = 0; i < count; i++) {
+            if (slots[i] >= 0) continue;
+            
+            slots[i] = find_process_index(table, infos[i].pid);
+            if (slots[i] >= 0) {
+                /* Another instance: keep whichever process started later */
+                if (TABLE_COL(table, COL_COLD, process_cold_t)[slots[i]].starttime > infos[i].starttime) {
+                    slots[i] = -1;
+                    continue;
+                }
+                table_set_info(table, slots[i], &infos[i]);
+            } else {
+                slots[i] = insert_entry(table, &infos[i]);
+            }
+            if (slots[i] >= 0) stored++;
+        }
+        unlock_table();
+    }
+    
+    if (stored > 0) {
+        __atomic_store_n(&table->last_sync, time(NULL), __ATOMIC_RELAXED);
+    }
+    return stored;
+}
+
+/* Remove process from table (O(1): its slot becomes a tombstone) */
 void remove_process(process_table_t *table, pid_t pid) {
     if (table == NULL) return;
     
@@ -145,31 +1029,366 @@ void remove_process(process_table_t *table, pid_t pid) {
     
     int index = find_process_index(table, pid);
     if (index >= 0) {
-        /* Shift remaining processes */
-        for (int i = index; i < table->count - 1; i++) {
-            memcpy(&table->processes[i], &table->processes[i + 1], sizeof(process_info_t));
-        }
-        table->count--;
+        tombstone_slot(table, index);
         table->last_sync = time(NULL);
     }
     
     unlock_table();
 }
 
-/* Get process by PID */
-process_info_t* get_process(process_table_t *table, pid_t pid) {
-    if (table == NULL) return NULL;
+/*
+ * Remove the entry of pid only while it still describes the process
+ * started at starttime, so a late exit report cannot drop a new process
+ * that reused the PID. Returns 0 if an entry was removed, else -1.
+ */
+int remove_process_instance(process_table_t *table, pid_t pid, unsigned long long starttime) {
+    int removed = -1;
+    
+    if (table == NULL) return -1;
     
     lock_table();
     
     int index = find_process_index(table, pid);
-    process_info_t *result = NULL;
+    if (index >= 0 && TABLE_COL(table, COL_COLD, process_cold_t)[index].starttime == starttime) {
+        tombstone_slot(table, index);
+        table->last_sync = time(NULL);
+        removed = 0;
+    }
     
-    if (index >= 0) {
-        result = &table->processes[index];
+    unlock_table();
+    return removed;
+}
+
+/* Copy the entry of a PID; -1 if it is not in the table */
+int get_process(process_table_t *table, pid_t pid, process_info_t *out) {
+    if (table == NULL || out == NULL) return -1;
+    
+    int index = lock_entry(table, pid);
+    if (index < 0) return -1;
+    
+    table_get_info(table, index, out);
+    unlock_entry(index);
+    return 0;
+}
+
+
+/*
+ * Merge a fully built shadow buffer into the table in one short critical
+ * section. Sampled PIDs keep their slots (new ones take free slots); entries
+ * neither in the shadow nor updated since 'since' (e.g. by fork events
+ * meanwhile) become tombstones.
+ */
+void publish_processes(process_table_t *table, const process_info_t *infos, int count, time_t since) {
+    int dropped = 0;
+    
+    if (table == NULL || infos == NULL) return;
+    
+    lock_table();
+    
+    for (int i = 0; i < count; i++) {
+        int slot = find_process_index(table, infos[i].pid);
+        
+        if (slot >= 0) {
+            table_set_info(table, slot, &infos[i]);
+        } else if (insert_entry(table, &infos[i]) < 0) {
+            dropped = count - i;
+            break;
+        }
+    }
+    
+    for (int i = table->count - 1; i >= 0; i--) {
+        if (table_pid(table, i) != 0 && table_last_update(table, i) < since) {
+            tombstone_slot(table, i);
+        }
     }
     
+    if (dropped > 0) {
+        log_message("Process table full: %d scanned processes not stored\n", dropped);
+    }
+    
+    table->last_sync = time(NULL);
     unlock_table();
-    return result;
 }
 
+/* Compare PIDs for bsearch */
+static int compare_pids(const void *a, const void *b) {
+    pid_t pa = *(const pid_t*)a;
+    pid_t pb = *(const pid_t*)b;
+    return (pa > pb) - (pa < pb);
+}
+
+/* Drop entries not in live_pids (sorted in place) unless updated since 'since' */
+int retain_processes(process_table_t *table, pid_t *live_pids, int live_count, time_t since) {
+    int removed = 0;
+    
+    if (table == NULL) return 0;
+    
+    qsort(live_pids, live_count, sizeof(pid_t), compare_pids);
+    
+    lock_table();
+    
+    /* Exited entries become tombstones; live ones keep their slots */
+    for (int i = table->count - 1; i >= 0; i--) {
+        pid_t pid = table_pid(table, i);
+        
+        /* Entries inserted after the enumeration (e.g. by fork events) stay */
+        if (pid != 0 && table_last_update(table, i) < since &&
+            bsearch(&pid, live_pids, live_count, sizeof(pid_t), compare_pids) == NULL) {
+            tombstone_slot(table, i);
+            removed++;
+        }
+    }
+    
+    if (removed > 0) {
+        table->last_sync = time(NULL);
+    }
+    
+    unlock_table();
+    return removed;
+}
+
+/* Flag a process for re-sampling by the reader pool */
+void mark_process_dirty(process_table_t *table, pid_t pid) {
+    if (table == NULL) return;
+    
+    int index = lock_entry(table, pid);
+    if (index >= 0) {
+        TABLE_COL(table, COL_DIRTY, unsigned char)[index] = 1;
+        unlock_entry(index);
+    }
+}
+
+/* Collect and clear the dirty flags one slot range at a time; returns the number of PIDs */
+int collect_dirty_processes(process_table_t *table, pid_t **pids, int *capacity) {
+    int count = 0;
+    
+    if (table == NULL) return 0;
+    
+    for (int first = 0; first < __atomic_load_n(&table->count, __ATOMIC_RELAXED); first += SHARD_SLOTS) {
+        int shard = shard_of_slot(first);
+        
+        lock_shard(shard);
+        
+        /* Structural writers hold every shard: entries and count are stable */
+        unsigned char *dirty = TABLE_COL(table, COL_DIRTY, unsigned char);
+        int last = first + SHARD_SLOTS;
+        if (last > table->count) last = table->count;
+        
+        for (int i = first; i < last; i++) {
+            if (!dirty[i]) continue;
+            
+            if (count == *capacity) {
+                int new_capacity = *capacity ? *capacity * 2 : 256;
+                pid_t *grown = (pid_t*)realloc(*pids, new_capacity * sizeof(pid_t));
+                if (grown == NULL) break;
+                *pids = grown;
+                *capacity = new_capacity;
+            }
+            (*pids)[count++] = table_pid(table, i);
+            dirty[i] = 0;
+        }
+        
+        unlock_shard(shard);
+    }
+    
+    return count;
+}
+
+/* Wait for an even sequence and return it */
+static unsigned int wait_even(const unsigned int *seqp) {
+    unsigned int seq;
+    int spins = 0;
+    
+    while ((seq = __atomic_load_n(seqp, __ATOMIC_ACQUIRE)) & 1) {
+        if (++spins < 100) {
+            sched_yield();
+        } else {
+            usleep(100);
+        }
+    }
+    return seq;
+}
+
+/* Record even sequences of the table and of every shard */
+static void read_begin(process_table_t *table, unsigned int *seqs) {
+    seqs[0] = wait_even(&table->seq);
+    for (int s = 0; s < TABLE_SHARDS; s++) {
+        seqs[s + 1] = wait_even(&table->shards[s].seq);
+    }
+}
+
+/* Whether any writer ran since read_begin() recorded seqs */
+static int read_retry(process_table_t *table, const unsigned int *seqs) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) != seqs[0]) return 1;
+    for (int s = 0; s < TABLE_SHARDS; s++) {
+        if (__atomic_load_n(&table->shards[s].seq, __ATOMIC_RELAXED) != seqs[s + 1]) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Layout for a lock-free reader, derived from the capacity it read rather
+ * than from header offsets a grower may be rewriting, and mapped locally.
+ * Returns 0, 1 if the header was caught mid-update, or -1 on failure.
+ */
+static int reader_layout(process_table_t *table, int *capacity, int *index_size, size_t *offsets) {
+    *capacity = __atomic_load_n(&table->capacity, __ATOMIC_RELAXED);
+    *index_size = __atomic_load_n(&table->index_size, __ATOMIC_RELAXED);
+    
+    if (*capacity <= 0 || *capacity > table->max_capacity || *index_size != index_size_for(*capacity)) {
+        return 1;
+    }
+    return map_to(layout_table(*capacity, *index_size, offsets)) == 0 ? 0 : -1;
+}
+
+/* Copy a consistent table snapshot without taking the lock (free() it when done) */
+process_table_t* snapshot_table(process_table_t *table) {
+    unsigned int seqs[TABLE_SHARDS + 1];
+    size_t offsets[TABLE_COLUMNS];
+    process_table_t *copy = NULL;
+    int capacity, index_size;
+    
+    if (table == NULL) return NULL;
+    
+    do {
+        read_begin(table, seqs);
+        
+        int rc = reader_layout(table, &capacity, &index_size, offsets);
+        if (rc < 0) break;
+        if (rc > 0) continue;
+        
+        int count = table->count;
+        if (count < 0) count = 0;
+        if (count > capacity) count = capacity;
+        
+        /* The copy is a table of its own, sized for the entries it holds */
+        if (copy == NULL || copy->capacity < count) {
+            int copy_capacity = count > 0 ? count : 1;
+            size_t copy_offsets[TABLE_COLUMNS];
+            
+            free(copy);
+            copy = (process_table_t*)malloc(layout_table(copy_capacity, index_size_for(copy_capacity), copy_offsets));
+            if (copy == NULL) return NULL;
+            memset(copy, 0, sizeof(*copy));
+            copy->capacity = copy_capacity;
+            copy->index_size = index_size_for(copy_capacity);
+            memcpy(copy->offsets, copy_offsets, sizeof(copy_offsets));
+        }
+        
+        copy->count = count;
+        copy->live = table->live;
+        copy->max_capacity = table->max_capacity;
+        copy->generation = table->generation;
+        copy->size = table->size;
+        copy->last_sync = table->last_sync;
+        copy->active = table->active;
+        copy->seq = seqs[0];
+        for (int col = 0; col < COL_FREE; col++) {
+            memcpy((char*)copy + copy->offsets[col], (char*)table + offsets[col],
+                   (size_t)count * column_sizes[col]);
+        }
+    } while (read_retry(table, seqs));
+    
+    if (copy != NULL) {
+        index_rebuild(copy);
+    }
+    return copy;
+}
+
+/*
+ * Visit every live entry without taking a lock or copying the table. Each
+ * range of SHARD_SLOTS slots is gathered into a private buffer under the
+ * table's and its shard's sequence counters, re-read until consistent, and
+ * then handed to visit(). Entries carry their string references but not
+ * the strings. Ranges are consistent on their own, not with each other;
+ * since live entries never change slots, each is visited at most once.
+ * Returns 0, or -1 on failure.
+ */
+int scan_table(process_table_t *table, table_visit_fn visit, void *ctx) {
+    size_t offsets[TABLE_COLUMNS];
+    process_info_t *entries;
+    int capacity, index_size;
+    
+    if (table == NULL || visit == NULL) return -1;
+    
+    entries = (process_info_t*)malloc(SHARD_SLOTS * sizeof(process_info_t));
+    if (entries == NULL) return -1;
+    
+    for (int first = 0; ; first += SHARD_SLOTS) {
+        table_shard_t *shard = &table->shards[shard_of_slot(first)];
+        int gathered;
+        
+        for (;;) {
+            unsigned int seq = wait_even(&table->seq);
+            unsigned int shard_seq = wait_even(&shard->seq);
+            
+            int rc = reader_layout(table, &capacity, &index_size, offsets);
+            if (rc < 0) {
+                free(entries);
+                return -1;
+            }
+            if (rc > 0) continue;
+            
+            int count = table->count;
+            if (count > capacity) count = capacity;
+            
+            /* -1: past the last slot */
+            gathered = first < count ? 0 : -1;
+            int last = first + SHARD_SLOTS < count ? first + SHARD_SLOTS : count;
+            for (int i = first; i < last; i++) {
+                if (COLUMN(table, offsets, COL_PID, const pid_t)[i] != 0) {
+                    gather_fields(table, offsets, i, &entries[gathered++]);
+                }
+            }
+            
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq &&
+                __atomic_load_n(&shard->seq, __ATOMIC_RELAXED) == shard_seq) break;
+        }
+        
+        if (gathered < 0) break;
+        if (gathered > 0) visit(entries, gathered, ctx);
+    }
+    
+    free(entries);
+    return 0;
+}
+
+/* Copy one process entry without taking the lock; -1 if not found */
+int snapshot_process(process_table_t *table, pid_t pid, process_info_t *out) {
+    size_t offsets[TABLE_COLUMNS];
+    unsigned int seq, shard_seq;
+    int capacity, index_size;
+    int found;
+    
+    if (table == NULL || out == NULL) return -1;
+    
+    for (;;) {
+        seq = wait_even(&table->seq);
+        
+        int rc = reader_layout(table, &capacity, &index_size, offsets);
+        if (rc < 0) return -1;
+        if (rc > 0) continue;
+        
+        const pid_index_entry_t *index = COLUMN(table, offsets, COL_INDEX, const pid_index_entry_t);
+        pid_index_entry_t entry = index[index_probe(index, index_size, pid)];
+        found = entry.pid == pid && entry.slot >= 0 && entry.slot < capacity;
+        if (!found) {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq) break;
+            continue;
+        }
+        
+        table_shard_t *shard = &table->shards[shard_of_slot(entry.slot)];
+        shard_seq = wait_even(&shard->seq);
+        gather_entry(table, offsets, entry.slot, out);
+        found = out->pid == pid;
+        
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq &&
+            __atomic_load_n(&shard->seq, __ATOMIC_RELAXED) == shard_seq) break;
+    }
+    
+    return found ? 0 : -1;
+}
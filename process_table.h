@@ -4,21 +4,52 @@
 #include "common.h"
 
 /* Shared Memory Functions */
+void set_table_max_capacity(int max_capacity);
 process_table_t* attach_shared_memory(void);
 void detach_shared_memory(process_table_t *table);
 void destroy_shared_memory(void);
 
-/* Semaphore Functions */
-int init_semaphores(void);
-void destroy_semaphores(void);
+/* Locking (process-shared robust mutexes in the segment) */
 void lock_table(void);
 void unlock_table(void);
+void lock_index(void);
+void unlock_index(void);
+void lock_shard(int shard);
+void unlock_shard(int shard);
+int shard_of_slot(int slot);
+void get_lock_stats(process_table_t *table, lock_stats_t *table_stats, lock_stats_t *shard_stats);
 
 /* Process Table Operations */
 int find_process_index(process_table_t *table, pid_t pid);
 void update_process_info(process_table_t *table, int index, process_info_t *info);
+int upsert_process(process_table_t *table, process_info_t *info);
+int replace_process(process_table_t *table, process_info_t *info);
+int commit_processes(process_table_t *table, const process_info_t *infos, int count, int insert, int *slots);
 void remove_process(process_table_t *table, pid_t pid);
-process_info_t* get_process(process_table_t *table, pid_t pid);
+int remove_process_instance(process_table_t *table, pid_t pid, unsigned long long starttime);
+void publish_processes(process_table_t *table, const process_info_t *infos, int count, time_t since);
+int retain_processes(process_table_t *table, pid_t *live_pids, int live_count, time_t since);
+int compact_table(process_table_t *table, int budget);
+void mark_process_dirty(process_table_t *table, pid_t pid);
+int collect_dirty_processes(process_table_t *table, pid_t **pids, int *capacity);
+int get_process(process_table_t *table, pid_t pid, process_info_t *out);
+
+/* Entry Accessors (the table stores hot columns and cold records) */
+void table_get_info(const process_table_t *table, int slot, process_info_t *out);
+void table_set_info(process_table_t *table, int slot, const process_info_t *info);
+pid_t table_pid(const process_table_t *table, int slot);
+pid_t table_ppid(const process_table_t *table, int slot);
+proc_state_t table_state(const process_table_t *table, int slot);
+double table_cpu_percent(const process_table_t *table, int slot);
+time_t table_last_update(const process_table_t *table, int slot);
+int table_dirty(const process_table_t *table, int slot);
+arena_ref_t table_name_ref(const process_table_t *table, int slot);
+
+/* Lock-free Snapshot Reads */
+typedef void (*table_visit_fn)(const process_info_t *entries, int count, void *ctx);
+process_table_t* snapshot_table(process_table_t *table);
+int scan_table(process_table_t *table, table_visit_fn visit, void *ctx);
+int snapshot_process(process_table_t *table, pid_t pid, process_info_t *out);
 
 #endif /* PROCESS_TABLE_H */
 
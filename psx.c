@@ -6,38 +6,50 @@
 #include "supervisor.h"
 #include "logger.h"
 #include "memory_allocator.h"
+#include "stats.h"
+#include "proc_events.h"
+#include "fd_cache.h"
+#include "cmdline_cache.h"
+#include "string_arena.h"
+#include "selector.h"
+#include "pidfd_watch.h"
+#include "query.h"
+#include "managed.h"
 
 static int daemon_mode = 0;
-static int server_running = 0;
+static int rpc_timeout_ms = RPC_DEFAULT_TIMEOUT_MS;
 
 /* Handle command messages */
 void handle_command(process_msg_t *msg) {
     process_table_t *table = attach_shared_memory();
+    process_info_t entry;
     process_info_t *proc;
-    int result = 0;
+    int status = 0;
     char response[256];
     
     if (table == NULL) {
         strcpy(response, "Error: Failed to access process table");
-        send_response(msg->mtype, response);
+        send_response(msg, EIO, response);
         return;
     }
     
-    proc = get_process(table, msg->target_pid);
+    proc = get_process(table, msg->target_pid, &entry) == 0 ? &entry : NULL;
     
     switch (msg->cmd) {
         case MSG_KILL:
             if (proc == NULL) {
+                status = ESRCH;
                 strcpy(response, "Error: Process not found");
             } else {
-                result = kill(msg->target_pid, msg->signal > 0 ? msg->signal : SIGTERM);
-                if (result == 0) {
+                status = signal_process(msg->target_pid, proc->starttime,
+                                        msg->signal > 0 ? msg->signal : SIGTERM);
+                if (status == 0) {
                     snprintf(response, sizeof(response), "Success: Sent signal %d to process %d",
                             msg->signal > 0 ? msg->signal : SIGTERM, msg->target_pid);
                     log_operation("KILL", msg->target_pid, response);
                 } else {
                     snprintf(response, sizeof(response), "Error: Failed to kill process: %s",
-                            strerror(errno));
+                            strerror(status));
                     log_operation("KILL", msg->target_pid, response);
                 }
             }
@@ -45,15 +57,16 @@ void handle_command(process_msg_t *msg) {
             
         case MSG_SUSPEND:
             if (proc == NULL) {
+                status = ESRCH;
                 strcpy(response, "Error: Process not found");
             } else {
-                result = kill(msg->target_pid, SIGSTOP);
-                if (result == 0) {
+                status = signal_process(msg->target_pid, proc->starttime, SIGSTOP);
+                if (status == 0) {
                     strcpy(response, "Success: Process suspended");
                     log_operation("SUSPEND", msg->target_pid, response);
                 } else {
                     snprintf(response, sizeof(response), "Error: Failed to suspend: %s",
-                            strerror(errno));
+                            strerror(status));
                     log_operation("SUSPEND", msg->target_pid, response);
                 }
             }
@@ -61,15 +74,16 @@ void handle_command(process_msg_t *msg) {
             
         case MSG_RESUME:
             if (proc == NULL) {
+                status = ESRCH;
                 strcpy(response, "Error: Process not found");
             } else {
-                result = kill(msg->target_pid, SIGCONT);
-                if (result == 0) {
+                status = signal_process(msg->target_pid, proc->starttime, SIGCONT);
+                if (status == 0) {
                     strcpy(response, "Success: Process resumed");
                     log_operation("RESUME", msg->target_pid, response);
                 } else {
                     snprintf(response, sizeof(response), "Error: Failed to resume: %s",
-                            strerror(errno));
+                            strerror(status));
                     log_operation("RESUME", msg->target_pid, response);
                 }
             }
@@ -81,35 +95,49 @@ void handle_command(process_msg_t *msg) {
             break;
             
         case MSG_SHUTDOWN:
-            server_running = 0;
             strcpy(response, "Success: Shutting down");
             break;
             
         default:
+            status = EINVAL;
             strcpy(response, "Error: Unknown command");
             break;
     }
     
-    send_response(msg->mtype, response);
+    send_response(msg, status, response);
 }
 
-/* Server loop to handle commands */
+/*
+ * Server loop to handle commands. Blocks in msgrcv until a command arrives,
+ * so commands run immediately and an idle daemon does not wake up. A
+ * MSG_SHUTDOWN message (also sent on SIGINT/SIGTERM) ends the loop.
+ */
 void* command_server(void *arg) {
     process_msg_t msg;
     
     log_message("Command server started\n");
     
-    while (server_running) {
-        if (receive_command(&msg) == 0) {
-            handle_command(&msg);
-        }
-        usleep(100000);  /* 100ms delay */
+    while (receive_command(&msg) == 0) {
+        handle_command(&msg);
+        if (msg.cmd == MSG_SHUTDOWN) break;
     }
     
     log_message("Command server stopped\n");
     return NULL;
 }
 
+/* Turn SIGINT/SIGTERM into a shutdown message that wakes the command server */
+static void* signal_waiter(void *arg) {
+    sigset_t *signals = (sigset_t*)arg;
+    int sig;
+    
+    if (sigwait(signals, &sig) == 0) {
+        log_message("Received signal %d, shutting down\n", sig);
+        send_command(MSG_SHUTDOWN, 0, 0);
+    }
+    return NULL;
+}
+
 /* Print process information */
 void print_process(process_info_t *proc) {
     const char *state_str[] = {
@@ -126,47 +154,101 @@ void print_process(process_info_t *proc) {
 /* List all processes */
 void list_processes(int show_all) {
     process_table_t *table = attach_shared_memory();
+    process_table_t *snapshot;
     
     if (table == NULL) {
         printf("Error: Failed to access process table\n");
         return;
     }
     
+    /* Print from a private copy so a slow terminal never holds up the daemon */
+    snapshot = snapshot_table(table);
+    if (snapshot == NULL) {
+        printf("Error: Failed to copy process table\n");
+        return;
+    }
+    
     printf("\n%-8s %-8s %-20s %-12s %10s %10s %12s %10s\n",
            "PID", "PPID", "NAME", "STATE", "CPU%", "MEM%", "VSIZE(KB)", "RSS(KB)");
     printf("%s\n", "-------------------------------------------------------------------------------------------");
     
-    lock_table();
-    
-    for (int i = 0; i < table->count; i++) {
-        process_info_t *proc = &table->processes[i];
+    for (int i = 0; i < snapshot->count; i++) {
+        process_info_t proc;
         
-        if (proc->pid == 0) continue;
+        /* Filter on the hot columns before gathering the strings */
+        if (table_pid(snapshot, i) == 0) continue;
         
-        if (!show_all && proc->state == PROC_ZOMBIE) {
+        if (!show_all && table_state(snapshot, i) == PROC_ZOMBIE) {
             continue;
         }
         
-        print_process(proc);
+        table_get_info(snapshot, i, &proc);
+        print_process(&proc);
     }
     
-    unlock_table();
-    printf("\nTotal processes: %d\n", table->count);
+    printf("\nTotal processes: %d\n", snapshot->live);
+    free(snapshot);
+}
+
+/*
+ * psx top [n | all] [by <key>] [filters...] [tsv]: the best n matches,
+ * evaluated straight on the shared table without copying it. tsv prints
+ * bare tab-separated rows for scripts. Returns the exit code.
+ */
+static int run_top(int argc, char *argv[]) {
+    process_table_t *table = attach_shared_memory();
+    process_query_t query;
+    process_info_t *rows;
+    char error[128];
+    int tsv = 0;
+    int count;
+    
+    if (argc > 0 && strcmp(argv[argc - 1], "tsv") == 0) {
+        tsv = 1;
+        argc--;
+    }
+    if (parse_query(argc, argv, &query, error, sizeof(error)) != 0) {
+        printf("Error: %s\n", error);
+        return 1;
+    }
+    
+    count = run_query(table, &query, &rows);
+    if (count < 0) {
+        printf("Error: Failed to read process table\n");
+        return 1;
+    }
+    
+    if (!tsv) {
+        printf("\n%-8s %-8s %-20s %-12s %10s %10s %12s %10s\n",
+               "PID", "PPID", "NAME", "STATE", "CPU%", "MEM%", "VSIZE(KB)", "RSS(KB)");
+        printf("%s\n", "-------------------------------------------------------------------------------------------");
+    }
+    for (int i = 0; i < count; i++) {
+        if (tsv) {
+            printf("%d\t%d\t%s\t%d\t%.2f\t%.2f\t%lu\t%ld\n",
+                   rows[i].pid, rows[i].ppid, rows[i].name, rows[i].state,
+                   rows[i].cpu_percent, rows[i].mem_percent, rows[i].vsize / 1024, rows[i].rss);
+        } else {
+            print_process(&rows[i]);
+        }
+    }
+    
+    free(rows);
+    return 0;
 }
 
 /* Show process details */
 void show_process_details(pid_t pid) {
     process_table_t *table = attach_shared_memory();
-    process_info_t *proc;
+    process_info_t entry;
+    process_info_t *proc = &entry;
     
     if (table == NULL) {
         printf("Error: Failed to access process table\n");
         return;
     }
     
-    proc = get_process(table, pid);
-    
-    if (proc == NULL) {
+    if (snapshot_process(table, pid, &entry) != 0) {
         printf("Process %d not found\n", pid);
         return;
     }
@@ -175,7 +257,19 @@ void show_process_details(pid_t pid) {
     printf("  PID: %d\n", proc->pid);
     printf("  PPID: %d\n", proc->ppid);
     printf("  Name: %s\n", proc->name);
-    printf("  Command: %s\n", proc->cmdline);
+    /* The entry carries a truncated copy; the arena holds the full one */
+    size_t cmdline_length = arena_length(proc->cmdline_ref);
+    char *full_cmdline = (char*)malloc(cmdline_length + 1);
+    if (full_cmdline != NULL) {
+        arena_copy(proc->cmdline_ref, full_cmdline, cmdline_length + 1);
+        /* Released and reused since the snapshot: fall back to the copy */
+        if (arena_stamp(proc->cmdline_ref) != proc->cmdline_stamp) {
+            free(full_cmdline);
+            full_cmdline = NULL;
+        }
+    }
+    printf("  Command: %s\n", full_cmdline != NULL ? full_cmdline : proc->cmdline);
+    free(full_cmdline);
     printf("  State: %d\n", proc->state);
     printf("  CPU Usage: %.2f%%\n", proc->cpu_percent);
     printf("  Memory Usage: %.2f%%\n", proc->mem_percent);
@@ -186,11 +280,272 @@ void show_process_details(pid_t pid) {
     printf("\n");
 }
 
+/* Count processes sampled by a benchmark scan */
+static void count_sample(process_info_t *info, void *ctx) {
+    (void)info;
+    (*(int*)ctx)++;
+}
+
+/* Compare full-scan wall time and syscall counts of the reader backends */
+void run_bench(int iterations) {
+    const char *backend_names[] = { "sync", "uring" };
+    pid_t *pids = NULL;
+    int capacity = 0;
+    system_snapshot_t sys;
+    
+    printf("\n%-8s %8s %12s %12s %14s\n",
+           "BACKEND", "SCANS", "PROCS/SCAN", "MS/SCAN", "SYSCALLS/SCAN");
+    printf("%s\n", "--------------------------------------------------------------");
+    
+    for (int b = READER_BACKEND_SYNC; b <= READER_BACKEND_URING; b++) {
+        struct timespec start, end;
+        unsigned long syscalls_before;
+        int sampled = 0;
+        
+        if (set_reader_backend((reader_backend_t)b) != 0) {
+            printf("%-8s unavailable\n", backend_names[b]);
+            continue;
+        }
+        
+        syscalls_before = get_proc_syscalls();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        
+        for (int i = 0; i < iterations; i++) {
+            int live = enumerate_pids(&pids, &capacity);
+            read_system_snapshot(&sys);
+            scan_processes(pids, live > 0 ? live : 0, &sys, count_sample, &sampled);
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                            (end.tv_nsec - start.tv_nsec) / 1e6;
+        
+        printf("%-8s %8d %12.1f %12.2f %14.1f\n", backend_names[b], iterations,
+               (double)sampled / iterations, elapsed_ms / iterations,
+               (double)(get_proc_syscalls() - syscalls_before) / iterations);
+    }
+    
+    printf("\nsync keeps /proc descriptors open after the first scan (pread re-sampling)\n");
+    
+    set_reader_backend(READER_BACKEND_SYNC);
+    free(pids);
+}
+
+/* Send one command to the daemon, wait for its reply and print it; returns the exit code */
+static int run_command(msg_type_t cmd, pid_t pid, int sig) {
+    rpc_request_t request;
+    
+    memset(&request, 0, sizeof(request));
+    request.cmd = cmd;
+    request.target_pid = pid;
+    request.signal = sig;
+    
+    rpc_call(&request, rpc_timeout_ms);
+    printf("%s\n", request.response);
+    return request.status == 0 ? 0 : 1;
+}
+
+/*
+ * Read commands from stdin, one per line ("kill <pid> [sig]", "suspend <pid>",
+ * "resume <pid>"), send them pipelined and print one result line per command
+ * in input order. Returns the exit code: 1 if any command failed.
+ */
+static int run_batch(void) {
+    rpc_request_t *requests = NULL;
+    int count = 0, capacity = 0, failed = 0;
+    char line[256];
+    struct timespec start, end;
+    
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        char verb[32];
+        int pid, sig = 0;
+        int fields = sscanf(line, "%31s %d %d", verb, &pid, &sig);
+        
+        if (fields < 2) {
+            if (fields == 1 && verb[0] != '#') {
+                fprintf(stderr, "Ignoring malformed line: %s", line);
+            }
+            continue;
+        }
+        
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 64;
+            rpc_request_t *grown = (rpc_request_t*)realloc(requests, new_capacity * sizeof(rpc_request_t));
+            if (grown == NULL) break;
+            requests = grown;
+            capacity = new_capacity;
+        }
+        
+        rpc_request_t *request = &requests[count];
+        memset(request, 0, sizeof(*request));
+        request->target_pid = pid;
+        if (strcmp(verb, "kill") == 0) {
+            request->cmd = MSG_KILL;
+            request->signal = fields == 3 ? sig : SIGTERM;
+        } else if (strcmp(verb, "suspend") == 0) {
+            request->cmd = MSG_SUSPEND;
+        } else if (strcmp(verb, "resume") == 0) {
+            request->cmd = MSG_RESUME;
+        } else {
+            fprintf(stderr, "Ignoring unknown command: %s", line);
+            continue;
+        }
+        count++;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rpc_pipeline(requests, count, rpc_timeout_ms);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    for (int i = 0; i < count; i++) {
+        printf("%-8d %s\n", requests[i].target_pid, requests[i].response);
+        if (requests[i].status != 0) failed++;
+    }
+    printf("%d commands, %d succeeded, %d failed in %.1f ms\n", count, count - failed, failed,
+           (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    
+    free(requests);
+    return failed > 0 ? 1 : 0;
+}
+
+/* Print one per-PID result of a group signal as it arrives */
+static void print_signal_result(const managed_reply_t *reply, void *ctx) {
+    (void)ctx;
+    printf("%-8d %s\n", reply->pid, reply->response);
+}
+
+/*
+ * Signal every process a selector matches ("name <comm>", "cmd <regex>",
+ * "uid <uid|user>", "ppid <pid>", "tree <pid>"); the daemon resolves it and
+ * sends one result per PID. The request goes over the control socket, so
+ * the daemon signals only what this uid could signal itself. Returns the
+ * exit code.
+ */
+static int run_signal_group(int argc, char *argv[]) {
+    managed_request_t request;
+    managed_reply_t reply;
+    
+    memset(&request, 0, sizeof(request));
+    request.cmd = MANAGED_CMD_SIGNAL;
+    request.signal = SIGTERM;
+    
+    if (argc < 2 || parse_selector(argv[0], &request.selector) != 0) {
+        printf("Error: Selector required: name <comm> | cmd <regex> | uid <uid> | ppid <pid> | tree <pid>\n");
+        return 1;
+    }
+    if (strlen(argv[1]) >= sizeof(request.argument)) {
+        printf("Error: Selector argument too long\n");
+        return 1;
+    }
+    strcpy(request.argument, argv[1]);
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "freeze") == 0) {
+            request.freeze = 1;
+        } else if (atoi(argv[i]) > 0) {
+            request.signal = atoi(argv[i]);
+        } else {
+            printf("Error: Unexpected argument: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    managed_call(&request, &reply, rpc_timeout_ms, print_signal_result, NULL);
+    printf("%s\n", reply.response);
+    return reply.status == 0 ? 0 : 1;
+}
+
+/*
+ * Launch a managed child: [always|on-failure|never] [max <n>] [window <s>]
+ * [backoff <ms>] [--] <command> [args...]. The request goes over the
+ * daemon's control socket, with the command as NUL-separated words.
+ * Returns the exit code.
+ */
+static int run_managed(int argc, char *argv[]) {
+    managed_request_t request;
+    managed_reply_t reply;
+    size_t used = 0;
+    int i = 0;
+    
+    memset(&request, 0, sizeof(request));
+    request.cmd = MANAGED_CMD_RUN;
+    request.restart.policy = RESTART_ON_FAILURE;
+    request.restart.max_restarts = MANAGED_DEFAULT_MAX_RESTARTS;
+    request.restart.window_secs = MANAGED_DEFAULT_WINDOW_SECS;
+    request.restart.backoff_ms = MANAGED_DEFAULT_BACKOFF_MS;
+    
+    for (; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (parse_restart_policy(argv[i], &request.restart.policy) == 0) {
+            continue;
+        }
+        if (value == NULL || atoi(value) < 0 ||
+            (strcmp(argv[i], "max") != 0 && strcmp(argv[i], "window") != 0 && strcmp(argv[i], "backoff") != 0)) {
+            break;  /* The command starts here */
+        }
+        if (argv[i][0] == 'm') {
+            request.restart.max_restarts = atoi(value);
+        } else if (argv[i][0] == 'w') {
+            request.restart.window_secs = atoi(value);
+        } else {
+            request.restart.backoff_ms = atoi(value);
+        }
+        i++;
+    }
+    
+    if (i >= argc) {
+        printf("Error: Command required\n");
+        return 1;
+    }
+    for (; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1;
+        
+        /* Room for the empty word that ends the list */
+        if (used + length >= sizeof(request.argument)) {
+            printf("Error: Command too long (%zu bytes at most)\n", sizeof(request.argument) - 2);
+            return 1;
+        }
+        memcpy(request.argument + used, argv[i], length);
+        used += length;
+    }
+    
+    managed_call(&request, &reply, rpc_timeout_ms, NULL, NULL);
+    printf("%s\n", reply.response);
+    return reply.status == 0 ? 0 : 1;
+}
+
+/* Stop a managed child through the control socket; returns the exit code */
+static int run_stop_managed(int id) {
+    managed_request_t request;
+    managed_reply_t reply;
+    
+    memset(&request, 0, sizeof(request));
+    request.cmd = MANAGED_CMD_STOP;
+    request.id = id;
+    
+    managed_call(&request, &reply, rpc_timeout_ms, NULL, NULL);
+    printf("%s\n", reply.response);
+    return reply.status == 0 ? 0 : 1;
+}
+
 /* Print usage information */
 void print_usage(const char *prog_name) {
     printf("Usage: %s [OPTIONS] [COMMAND] [ARGS]\n", prog_name);
     printf("\nOptions:\n");
     printf("  -d          Run as daemon\n");
+    printf("  -b <name>   Full-scan reader backend: sync (default) or uring\n");
+    printf("  -m <n>      Maximum table size when the segment is created\n");
+    printf("              (default %d, or PSX_MAX_PROCESSES)\n", TABLE_DEFAULT_MAX_CAPACITY);
+    printf("  -t <ms>     How long to wait for a daemon reply (default %d)\n", RPC_DEFAULT_TIMEOUT_MS);
+    printf("  -p <name>   Refresh priority policy: adaptive (default) or tiers\n");
+    printf("  -r <n>      Refresh samples per second, all processes (default %.0f)\n", SCHEDULER_DEFAULT_BUDGET);
+    printf("  -w <n>      Refresh worker threads (default: CPUs, at most %d)\n", SCHEDULER_DEFAULT_WORKERS);
+    printf("  -P          Pin each refresh worker to its own CPU\n");
     printf("  -h          Show this help message\n");
     printf("\nCommands:\n");
     printf("  list              List all processes\n");
@@ -201,37 +556,93 @@ void print_usage(const char *prog_name) {
     printf("  suspend <pid>     Suspend a process (SIGSTOP)\n");
     printf("  resume <pid>      Resume a process (SIGCONT)\n");
     printf("  update            Update process table\n");
+    printf("  batch             Run kill/suspend/resume lines from stdin, pipelined\n");
+    printf("  signal <selector> <value> [sig] [freeze]\n");
+    printf("                    Signal every match of name, cmd (regex), uid, ppid or\n");
+    printf("                    tree (PID and descendants; freeze stops it first)\n");
+    printf("  top [n|all] [by cpu|mem|rss|pid] [state R|S|T|Z] [user <u>] [name <comm>]\n");
+    printf("      [cpu <min%%>] [mem <min%%>] [tsv]\n");
+    printf("                    Top matches (default 10 by CPU) without copying the table\n");
+    printf("  run [always|on-failure|never] [max <n>] [window <s>] [backoff <ms>] [--] <cmd...>\n");
+    printf("                    Launch a managed child, restarted as the policy says\n");
+    printf("                    (default on-failure, max %d per %d s, backoff %d ms)\n",
+           MANAGED_DEFAULT_MAX_RESTARTS, MANAGED_DEFAULT_WINDOW_SECS, MANAGED_DEFAULT_BACKOFF_MS);
+    printf("  stop <id>         Stop a managed child for good\n");
     printf("  stats             Show system statistics\n");
+    printf("  bench [n]         Compare reader backends over n full scans\n");
     printf("\n");
 }
 
 /* Main function */
 int main(int argc, char *argv[]) {
-    pthread_t server_tid;
+    pthread_t server_tid, signal_tid;
+    sigset_t shutdown_signals, child_signal;
+    int exit_code = 0;
+    int worker_count = 0;
+    int pin_workers = 0;
     int opt;
     
     /* Initialize components */
     init_logger();
     init_allocator();
     
-    if (init_semaphores() == -1) {
-        error_exit("Failed to initialize semaphores");
-    }
-    
     if (init_message_queue() == -1) {
         error_exit("Failed to initialize message queue");
     }
     
-    if (attach_shared_memory() == NULL) {
-        error_exit("Failed to attach shared memory");
-    }
-    
     /* Parse command line options */
-    while ((opt = getopt(argc, argv, "dh")) != -1) {
+    while ((opt = getopt(argc, argv, "db:m:t:p:r:w:Ph")) != -1) {
         switch (opt) {
             case 'd':
                 daemon_mode = 1;
                 break;
+            case 'b':
+                if (strcmp(optarg, "uring") == 0) {
+                    if (set_reader_backend(READER_BACKEND_URING) != 0) {
+                        log_message("io_uring backend unavailable, using sync reads\n");
+                    }
+                } else if (strcmp(optarg, "sync") != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'm':
+                if (atoi(optarg) <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                set_table_max_capacity(atoi(optarg));
+                break;
+            case 't':
+                if (atoi(optarg) <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                rpc_timeout_ms = atoi(optarg);
+                break;
+            case 'p':
+                if (set_priority_policy(optarg) != 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'r':
+                if (atof(optarg) <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                set_sample_budget(atof(optarg));
+                break;
+            case 'w':
+                if (atoi(optarg) <= 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                worker_count = atoi(optarg);
+                break;
+            case 'P':
+                pin_workers = 1;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -241,27 +652,56 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    if (attach_shared_memory() == NULL) {
+        error_exit("Failed to attach shared memory");
+    }
+    
     /* If no command specified, start daemon/server mode */
     if (optind >= argc) {
         daemon_mode = 1;
     }
     
     if (daemon_mode) {
-        /* Start background services */
-        server_running = 1;
+        /* Handle shutdown signals on one thread; every later thread inherits the mask */
+        sigemptyset(&shutdown_signals);
+        sigaddset(&shutdown_signals, SIGINT);
+        sigaddset(&shutdown_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL);
         
-        /* Start process reader threads */
-        start_proc_reader_threads(4);
+        /* SIGCHLD stays blocked everywhere too: the supervisor reads it from a signalfd */
+        sigemptyset(&child_signal);
+        sigaddset(&child_signal, SIGCHLD);
+        pthread_sigmask(SIG_BLOCK, &child_signal, NULL);
         
-        /* Initial process collection */
-        collect_all_processes();
+        if (pthread_create(&signal_tid, NULL, signal_waiter, &shutdown_signals) == 0) {
+            pthread_detach(signal_tid);
+        }
         
-        /* Start scheduler */
+        /* Keep /proc/<pid> descriptors open between samples */
+        init_fd_cache();
+        
+        /* Start scheduler before anything inserts processes it must track */
+        set_scheduler_workers(worker_count, pin_workers);
         init_scheduler();
         
+        /* Track fork/exec/exit as they happen when the kernel allows it */
+        start_proc_events();
+        
+        /* Hold pidfds for exit notifications and race-free signals */
+        start_pidfd_watch();
+        
+        /* Start process reader threads (pool sized by cores) */
+        start_proc_reader_threads(0);
+        
+        /* Initial process collection */
+        collect_all_processes();
+        
         /* Start supervisor */
         init_supervisor();
         
+        /* Take run/stop on a socket that checks the caller's uid, not on the queue */
+        start_managed_server();
+        
         /* Start command server */
         if (pthread_create(&server_tid, NULL, command_server, NULL) != 0) {
             error_exit("Failed to create server thread");
@@ -273,12 +713,18 @@ int main(int argc, char *argv[]) {
         pthread_join(server_tid, NULL);
         
         /* Cleanup */
+        stop_managed_server();
+        stop_all_managed();
+        stop_proc_events();
         stop_proc_reader_threads();
         cleanup_scheduler();
         cleanup_supervisor();
+        stop_pidfd_watch();
+        cleanup_cpu_samples();
+        cleanup_fd_cache();
+        cleanup_process_strings();
         cleanup_allocator();
         destroy_shared_memory();
-        destroy_semaphores();
         destroy_message_queue();
         close_logger();
         
@@ -305,8 +751,7 @@ int main(int argc, char *argv[]) {
         }
         pid_t pid = atoi(argv[optind + 1]);
         int sig = (optind + 2 < argc) ? atoi(argv[optind + 2]) : SIGTERM;
-        send_command(MSG_KILL, pid, sig);
-        printf("Kill command sent to process %d\n", pid);
+        exit_code = run_command(MSG_KILL, pid, sig);
         
     } else if (strcmp(argv[optind], "suspend") == 0) {
         if (optind + 1 >= argc) {
@@ -314,8 +759,7 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         pid_t pid = atoi(argv[optind + 1]);
-        send_command(MSG_SUSPEND, pid, 0);
-        printf("Suspend command sent to process %d\n", pid);
+        exit_code = run_command(MSG_SUSPEND, pid, 0);
         
     } else if (strcmp(argv[optind], "resume") == 0) {
         if (optind + 1 >= argc) {
@@ -323,26 +767,121 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         pid_t pid = atoi(argv[optind + 1]);
-        send_command(MSG_RESUME, pid, 0);
-        printf("Resume command sent to process %d\n", pid);
+        exit_code = run_command(MSG_RESUME, pid, 0);
         
     } else if (strcmp(argv[optind], "update") == 0) {
-        send_command(MSG_UPDATE, 0, 0);
-        printf("Update command sent\n");
+        exit_code = run_command(MSG_UPDATE, 0, 0);
+        
+    } else if (strcmp(argv[optind], "batch") == 0) {
+        exit_code = run_batch();
+        
+    } else if (strcmp(argv[optind], "signal") == 0) {
+        exit_code = run_signal_group(argc - optind - 1, argv + optind + 1);
+        
+    } else if (strcmp(argv[optind], "run") == 0) {
+        exit_code = run_managed(argc - optind - 1, argv + optind + 1);
+        
+    } else if (strcmp(argv[optind], "stop") == 0) {
+        if (optind + 1 >= argc) {
+            printf("Error: Managed child id required\n");
+            return 1;
+        }
+        exit_code = run_stop_managed(atoi(argv[optind + 1]));
+        
+    } else if (strcmp(argv[optind], "top") == 0) {
+        exit_code = run_top(argc - optind - 1, argv + optind + 1);
         
     } else if (strcmp(argv[optind], "stats") == 0) {
         process_table_t *table = attach_shared_memory();
-        if (table != NULL) {
-            lock_table();
+        process_table_t *snapshot = snapshot_table(table);
+        if (snapshot != NULL) {
             printf("\nSystem Statistics:\n");
-            printf("  Total Processes: %d\n", table->count);
-            printf("  Last Sync: %s", ctime(&table->last_sync));
-            unlock_table();
+            printf("  Total Processes: %d\n", snapshot->live);
+            printf("  Tombstoned Slots: %d\n", snapshot->count - snapshot->live);
+            printf("  Table Capacity: %d slots (max %d), %zu KB in use, grown %u times\n",
+                   table->capacity, snapshot->max_capacity, snapshot->size / 1024, snapshot->generation);
+            printf("  Last Sync: %s", ctime(&snapshot->last_sync));
+            
+            arena_stats_t arena_stats;
+            get_arena_stats(&arena_stats);
+            printf("  String Arena: %lu strings, %lu KB live, %zu KB allocated, %.1f%% interned hits\n",
+                   arena_stats.strings, arena_stats.live_bytes / 1024, arena_stats.size / 1024,
+                   arena_stats.intern_calls > 0 ? 100.0 * arena_stats.intern_hits / arena_stats.intern_calls : 0.0);
+            
+            lock_stats_t lock_stats[2];
+            const char *lock_names[2] = { "Table", "Shards" };
+            get_lock_stats(table, &lock_stats[0], &lock_stats[1]);
+            
+            printf("\nLock Contention:\n");
+            for (int i = 0; i < 2; i++) {
+                lock_stats_t *ls = &lock_stats[i];
+                printf("  %-7s %llu acquisitions, %llu contended, avg wait %.1f us, max wait %.1f us",
+                       lock_names[i], ls->acquisitions, ls->contended,
+                       ls->contended ? ls->wait_ns / 1000.0 / ls->contended : 0.0,
+                       ls->max_wait_ns / 1000.0);
+                printf(", avg hold %.1f us, max hold %.1f us",
+                       ls->acquisitions ? ls->hold_ns / 1000.0 / ls->acquisitions : 0.0,
+                       ls->max_hold_ns / 1000.0);
+                if (ls->owner_died) {
+                    printf(", %llu recovered", ls->owner_died);
+                }
+                printf("\n");
+            }
+            
+            /* Live counters, like the lock stats: the daemon's scheduler updates them in place */
+            const scheduler_stats_t *sched = &table->scheduler_stats;
+            printf("\nScheduler:\n");
+            printf("  Policy: %s, %d processes tracked, %llu refreshes\n",
+                   sched->policy[0] ? sched->policy : "none", sched->tracked, sched->samples);
+            printf("  Budget: %.0f samples/s, demand %.1f samples/s, intervals stretched x%.2f\n",
+                   sched->budget, sched->demand, sched->stretch);
+            printf("  Workers: %d%s, %llu chunks stolen\n",
+                   sched->workers, sched->pinned ? " (pinned)" : "", sched->steals);
+            printf("  Lag: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms, %llu deadlines missed (> %.0f ms)\n",
+                   scheduler_lag_percentile(sched, 0.50) * 1000.0,
+                   scheduler_lag_percentile(sched, 0.90) * 1000.0,
+                   scheduler_lag_percentile(sched, 0.99) * 1000.0,
+                   sched->max_lag_ns / 1e6, sched->missed, SCHEDULER_MISS_SECS * 1000.0);
+            
+            const zombie_stats_t *zombies = &table->zombie_stats;
+            printf("\nZombies:\n");
+            printf("  %d zombies held by %d parents, %llu children of the daemon reaped\n",
+                   zombies->zombies, zombies->holders, zombies->reaped);
+            for (int i = 0; i < ZOMBIE_TOP_HOLDERS && zombies->top[i].ppid > 0; i++) {
+                process_info_t parent;
+                const char *name = snapshot_process(table, zombies->top[i].ppid, &parent) == 0 ? parent.name : "?";
+                printf("  Parent %d (%s): %d zombies, holding for %ld s\n",
+                       zombies->top[i].ppid, name, zombies->top[i].zombies,
+                       (long)(zombies->last_sweep - zombies->top[i].since));
+            }
+            
+            printf("\nManaged Children:\n");
+            for (int i = 0; i < MANAGED_MAX; i++) {
+                const managed_stats_t *child = &table->managed[i];
+                if (child->id == 0) continue;
+                printf("  [%d] %s, restart %s, PID %d, %u restarts", child->id,
+                       managed_state_name(child->state), restart_policy_name(child->policy),
+                       child->pid, child->restarts);
+                if (child->restarts > 0 || child->state != MANAGED_RUNNING) {
+                    printf(", last exit %d", child->last_exit);
+                }
+                if (child->restarts > 0) {
+                    printf(", restart latency last %.2f ms, avg %.2f ms, max %.2f ms",
+                           child->last_restart_ms,
+                           child->total_restart_ms / child->restarts, child->max_restart_ms);
+                }
+                printf(": %s\n", child->command);
+            }
             
             printf("\nMemory Allocator:\n");
             printf("  Total Allocated: %zu bytes\n", get_total_allocated());
             printf("  Total Free: %zu bytes\n", get_total_free());
         }
+        free(snapshot);
+        
+    } else if (strcmp(argv[optind], "bench") == 0) {
+        int iterations = (optind + 1 < argc) ? atoi(argv[optind + 1]) : 10;
+        run_bench(iterations > 0 ? iterations : 10);
         
     } else {
         printf("Unknown command: %s\n", argv[optind]);
@@ -354,6 +893,6 @@ int main(int argc, char *argv[]) {
     detach_shared_memory(attach_shared_memory());
     close_logger();
     
-    return 0;
+    return exit_code;
 }
 
@@ -0,0 +1,251 @@
+#include "query.h"
+#include "process_table.h"
+#include "string_arena.h"
+#include <pwd.h>
+
+static const char *sort_words[] = { "cpu", "mem", "rss", "pid" };
+
+/* Matches collected by run_query(): a bounded heap, worst row at the root */
+typedef struct {
+    const process_query_t *query;
+    process_info_t *rows;
+    int count;
+    int capacity;
+} query_result_t;
+
+/* Negative when a ranks before b: metrics descending, then PID ascending */
+static int compare_rows(const process_info_t *a, const process_info_t *b, query_sort_t sort) {
+    switch (sort) {
+        case QUERY_SORT_CPU:
+            if (a->cpu_percent != b->cpu_percent) return a->cpu_percent > b->cpu_percent ? -1 : 1;
+            break;
+        case QUERY_SORT_MEM:
+            if (a->mem_percent != b->mem_percent) return a->mem_percent > b->mem_percent ? -1 : 1;
+            break;
+        case QUERY_SORT_RSS:
+            if (a->rss != b->rss) return a->rss > b->rss ? -1 : 1;
+            break;
+        case QUERY_SORT_PID:
+            break;
+    }
+    return (a->pid > b->pid) - (a->pid < b->pid);
+}
+
+/* compare_rows() for qsort_r(); arg points at the sort key */
+static int compare_sorted(const void *a, const void *b, void *arg) {
+    return compare_rows((const process_info_t*)a, (const process_info_t*)b, *(const query_sort_t*)arg);
+}
+
+/* Swap two rows */
+static void swap_rows(process_info_t *a, process_info_t *b) {
+    process_info_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* Move a row up until its parent ranks no better */
+static void sift_up(query_result_t *result, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (compare_rows(&result->rows[parent], &result->rows[i], result->query->sort) >= 0) break;
+        swap_rows(&result->rows[parent], &result->rows[i]);
+        i = parent;
+    }
+}
+
+/* Move the root down until both children rank no worse */
+static void sift_down(query_result_t *result) {
+    int i = 0;
+    
+    for (;;) {
+        int worst = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        
+        if (left < result->count &&
+            compare_rows(&result->rows[left], &result->rows[worst], result->query->sort) > 0) {
+            worst = left;
+        }
+        if (right < result->count &&
+            compare_rows(&result->rows[right], &result->rows[worst], result->query->sort) > 0) {
+            worst = right;
+        }
+        if (worst == i) break;
+        swap_rows(&result->rows[worst], &result->rows[i]);
+        i = worst;
+    }
+}
+
+/* Whether an entry satisfies the query's predicate */
+static int matches(const process_query_t *query, const process_info_t *entry) {
+    if (query->state >= 0 && (int)entry->state != query->state) return 0;
+    if (query->match_uid && entry->uid != query->uid) return 0;
+    if (query->match_name && entry->name_ref != query->name) return 0;
+    if (entry->cpu_percent < query->min_cpu) return 0;
+    if (entry->mem_percent < query->min_mem) return 0;
+    return 1;
+}
+
+/*
+ * Keep the best matches of one range. With a limit, the rows form a heap of
+ * at most limit entries with the worst at the root, so a match costs
+ * O(log limit) and only beats the root to get in.
+ */
+static void collect_matches(const process_info_t *entries, int count, void *ctx) {
+    query_result_t *result = (query_result_t*)ctx;
+    const process_query_t *query = result->query;
+    
+    for (int i = 0; i < count; i++) {
+        if (!matches(query, &entries[i])) continue;
+        
+        if (query->limit > 0 && result->count == query->limit) {
+            if (compare_rows(&entries[i], &result->rows[0], query->sort) < 0) {
+                result->rows[0] = entries[i];
+                sift_down(result);
+            }
+            continue;
+        }
+        
+        if (result->count == result->capacity) {
+            int new_capacity = result->capacity ? result->capacity * 2 : 64;
+            if (query->limit > 0 && new_capacity > query->limit) new_capacity = query->limit;
+            process_info_t *grown = (process_info_t*)realloc(result->rows, new_capacity * sizeof(process_info_t));
+            if (grown == NULL) continue;
+            result->rows = grown;
+            result->capacity = new_capacity;
+        }
+        result->rows[result->count++] = entries[i];
+        if (query->limit > 0) {
+            sift_up(result, result->count - 1);
+        }
+    }
+}
+
+/*
+ * Evaluate a query on the shared table without locking or copying it: the
+ * predicate runs on each entry as scan_table() visits it, and only the rows
+ * kept are sorted and get their strings. Returns the row count (*rows is
+ * malloc'd, best first), or -1 on failure.
+ */
+int run_query(process_table_t *table, const process_query_t *query, process_info_t **rows) {
+    query_result_t result;
+    
+    *rows = NULL;
+    
+    /* A name no process ever had is not in the arena */
+    if (query->match_name && query->name == 0) return 0;
+    
+    memset(&result, 0, sizeof(result));
+    result.query = query;
+    
+    if (scan_table(table, collect_matches, &result) != 0) {
+        free(result.rows);
+        return -1;
+    }
+    
+    qsort_r(result.rows, result.count, sizeof(process_info_t), compare_sorted, (void*)&query->sort);
+    
+    for (int i = 0; i < result.count; i++) {
+        arena_copy(result.rows[i].name_ref, result.rows[i].name, sizeof(result.rows[i].name));
+        arena_copy(result.rows[i].cmdline_ref, result.rows[i].cmdline, sizeof(result.rows[i].cmdline));
+    }
+    
+    *rows = result.rows;
+    return result.count;
+}
+
+/* Parse a state word (R/S/T/Z or its name); -1 if unknown */
+static int parse_state(const char *word) {
+    if (strcmp(word, "R") == 0 || strcmp(word, "running") == 0) return PROC_RUNNING;
+    if (strcmp(word, "S") == 0 || strcmp(word, "sleeping") == 0) return PROC_SLEEPING;
+    if (strcmp(word, "T") == 0 || strcmp(word, "stopped") == 0) return PROC_STOPPED;
+    if (strcmp(word, "Z") == 0 || strcmp(word, "zombie") == 0) return PROC_ZOMBIE;
+    return -1;
+}
+
+/* Parse a non-negative number; -1 if the word is not one */
+static double parse_number(const char *word) {
+    char *end;
+    double value = strtod(word, &end);
+    
+    return (*word != '\0' && *end == '\0' && value >= 0) ? value : -1;
+}
+
+/*
+ * Parse query words: [n | all] [by cpu|mem|rss|pid] [state R|S|T|Z]
+ * [user <uid|name>] [name <comm>] [cpu <min%>] [mem <min%>], in any order.
+ * Returns 0, or -1 with a message in error.
+ */
+int parse_query(int argc, char *argv[], process_query_t *query, char *error, size_t error_len) {
+    memset(query, 0, sizeof(*query));
+    query->state = -1;
+    query->sort = QUERY_SORT_CPU;
+    query->limit = QUERY_DEFAULT_LIMIT;
+    
+    for (int i = 0; i < argc; i++) {
+        const char *word = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (strcmp(word, "all") == 0) {
+            query->limit = 0;
+            continue;
+        }
+        if (parse_number(word) >= 1) {
+            /* More rows than the table can hold means all of them */
+            query->limit = parse_number(word) < TABLE_DEFAULT_MAX_CAPACITY * 64.0 ? (int)parse_number(word) : 0;
+            continue;
+        }
+        if (value == NULL) {
+            snprintf(error, error_len, "Missing value after %s", word);
+            return -1;
+        }
+        i++;
+        
+        if (strcmp(word, "by") == 0) {
+            int found = 0;
+            for (int k = 0; k < (int)(sizeof(sort_words) / sizeof(sort_words[0])); k++) {
+                if (strcmp(value, sort_words[k]) == 0) {
+                    query->sort = (query_sort_t)k;
+                    found = 1;
+                }
+            }
+            if (!found) {
+                snprintf(error, error_len, "Unknown sort key: %s (cpu, mem, rss or pid)", value);
+                return -1;
+            }
+        } else if (strcmp(word, "state") == 0) {
+            query->state = parse_state(value);
+            if (query->state < 0) {
+                snprintf(error, error_len, "Unknown state: %s (R, S, T or Z)", value);
+                return -1;
+            }
+        } else if (strcmp(word, "user") == 0) {
+            double uid = parse_number(value);
+            if (uid < 0) {
+                struct passwd *pw = getpwnam(value);
+                if (pw == NULL) {
+                    snprintf(error, error_len, "Unknown user: %s", value);
+                    return -1;
+                }
+                uid = pw->pw_uid;
+            }
+            query->match_uid = 1;
+            query->uid = (uid_t)uid;
+        } else if (strcmp(word, "name") == 0) {
+            query->match_name = 1;
+            query->name = arena_find(value, strlen(value));
+        } else if (strcmp(word, "cpu") == 0 || strcmp(word, "mem") == 0) {
+            double min = parse_number(value);
+            if (min < 0) {
+                snprintf(error, error_len, "Invalid %s threshold: %s", word, value);
+                return -1;
+            }
+            if (word[0] == 'c') query->min_cpu = min; else query->min_mem = min;
+        } else {
+            snprintf(error, error_len, "Unexpected argument: %s", word);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "common.h"
+
+#define QUERY_DEFAULT_LIMIT 10      /* Rows `psx top` prints unless told otherwise */
+
+/* Sort Keys (metrics descending, PID ascending) */
+typedef enum {
+    QUERY_SORT_CPU,
+    QUERY_SORT_MEM,
+    QUERY_SORT_RSS,
+    QUERY_SORT_PID
+} query_sort_t;
+
+/* Process Query: a predicate, a sort key and a row limit */
+typedef struct {
+    int state;                /* proc_state_t to match, or -1 for any */
+    int match_uid;
+    uid_t uid;
+    int match_name;
+    arena_ref_t name;         /* Interned name; 0 if no process ever had it */
+    double min_cpu;           /* Percent */
+    double min_mem;           /* Percent */
+    query_sort_t sort;
+    int limit;                /* Rows to return; 0 for every match */
+} process_query_t;
+
+/* Query Functions */
+int parse_query(int argc, char *argv[], process_query_t *query, char *error, size_t error_len);
+int run_query(process_table_t *table, const process_query_t *query, process_info_t **rows);
+
+#endif /* QUERY_H */
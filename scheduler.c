@@ -3,9 +3,82 @@
 #include "logger.h"
 #include "proc_reader.h"
 #include "stats.h"
+#include "cmdline_cache.h"
+#include "work_queue.h"
+#include <math.h>
+#include <sched.h>
+
+#define ADAPTIVE_ALPHA 0.3          /* EWMA weight of the newest observation */
+#define ADAPTIVE_SPREAD 2.0         /* Standard deviations added to each mean */
+#define ADAPTIVE_RSS_WEIGHT 10.0    /* CPU percent that 1 MB/s of RSS change counts as */
+#define ADAPTIVE_WARMUP 3           /* Observations before an interval may exceed 1 s */
+
+/* Refresh deadline of one process identity */
+typedef struct {
+    double deadline;          /* CLOCK_MONOTONIC seconds */
+    pid_t pid;
+    unsigned long long starttime;
+} refresh_timer_t;
+
+/* Tracked identity; a PID maps to the process it currently names */
+typedef struct tracked_process {
+    pid_t pid;
+    unsigned long long starttime;
+    process_trend_t trend;
+    double rate;              /* Refreshes per second the policy asked for */
+    struct tracked_process *next;
+} tracked_process_t;
+
+/* Due refreshes handed to a worker in one piece */
+typedef struct {
+    system_snapshot_t sys;    /* Taken once per dispatch round */
+    int count;
+    refresh_timer_t timers[SCHEDULER_CHUNK];
+} refresh_chunk_t;
 
 static pthread_t scheduler_tid;
 static int scheduler_running = 0;
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_wake;
+
+/* Min-heap of deadlines, one timer per tracked identity (guarded by sched_lock) */
+static refresh_timer_t *timers = NULL;
+static int timer_count = 0;
+static int timer_capacity = 0;
+static tracked_process_t *tracked[SCHEDULER_BUCKETS];
+static int tracked_count = 0;
+
+/* Sample budget: a token bucket refilled at sample_budget per second (guarded by sched_lock) */
+static double sample_budget = SCHEDULER_DEFAULT_BUDGET;
+static double demand = 0.0;             /* Sum of the tracked rates */
+static double tokens = 0.0;
+static double tokens_at = 0.0;
+static unsigned long long samples_taken = 0;
+
+/* Deadline lag (guarded by sched_lock) */
+static unsigned long long missed = 0;
+static unsigned long long steals = 0;
+static unsigned long long max_lag_ns = 0;
+static unsigned long long lag_buckets[SCHEDULER_LAG_BUCKETS];
+
+/* Refresh workers: one deque each, fed round-robin by the dispatcher; idle ones steal */
+static pthread_t *worker_tids = NULL;
+static work_deque_t *worker_deques = NULL;
+static int num_workers = 0;
+static int requested_workers = 0;       /* 0 for the default */
+static int pin_workers = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static int queued_chunks = 0;           /* Pushed and not yet claimed (guarded by pool_lock) */
+static process_table_t *sched_table = NULL;
+
+/* Get monotonic time in seconds */
+static double monotonic_now(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 /* Get update priority based on process characteristics */
 priority_level_t get_update_priority(pid_t pid, double cpu_usage) {
@@ -32,80 +105,655 @@ int get_update_interval(priority_level_t priority) {
     }
 }
 
-/* Scheduler thread function */
-void* scheduler_thread(void *arg) {
-    process_table_t *table;
-    time_t last_update[MAX_PROCESSES];
-    priority_level_t priorities[MAX_PROCESSES];
-    int update_intervals[MAX_PROCESSES];
+/* Fixed tiers: 1, 3 or 5 s from the latest CPU reading */
+static double tiered_interval(const process_trend_t *trend, const process_info_t *info) {
+    (void)trend;
+    return get_update_interval(get_update_priority(info->pid, info->cpu_percent));
+}
+
+/*
+ * Adaptive: activity is the CPU EWMA plus ADAPTIVE_SPREAD standard
+ * deviations, with the RSS change rate weighed in the same way, so a
+ * bursty process is sampled as if it always ran at its peaks. The interval
+ * falls geometrically with the square root of activity, from
+ * SCHEDULER_MAX_INTERVAL when idle to SCHEDULER_MIN_INTERVAL at one full CPU.
+ */
+static double adaptive_interval(const process_trend_t *trend, const process_info_t *info) {
+    double cpu = trend->cpu_mean + ADAPTIVE_SPREAD * sqrt(trend->cpu_var);
+    double rss_mb = (trend->rss_mean + ADAPTIVE_SPREAD * sqrt(trend->rss_var)) / 1024.0;
+    double level = (cpu + ADAPTIVE_RSS_WEIGHT * rss_mb) / 100.0;
+    double interval;
+    (void)info;
+    
+    if (level > 1.0) level = 1.0;
+    if (level < 0.0) level = 0.0;
+    interval = SCHEDULER_MAX_INTERVAL * pow(SCHEDULER_MIN_INTERVAL / SCHEDULER_MAX_INTERVAL, sqrt(level));
+    
+    /* Too few observations to trust a long interval yet */
+    if (trend->samples < ADAPTIVE_WARMUP && interval > 1.0) {
+        interval = 1.0;
+    }
+    return interval;
+}
+
+static const priority_policy_t policies[] = {
+    { "adaptive", adaptive_interval },
+    { "tiers", tiered_interval }
+};
+static const priority_policy_t *policy = &policies[0];
+
+/* Select the priority policy by name before init_scheduler(); -1 if unknown */
+int set_priority_policy(const char *name) {
+    for (int i = 0; i < (int)(sizeof(policies) / sizeof(policies[0])); i++) {
+        if (strcmp(name, policies[i].name) == 0) {
+            policy = &policies[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Set the refresh samples per second all processes share, before init_scheduler() */
+void set_sample_budget(double samples_per_sec) {
+    if (samples_per_sec > 0) {
+        sample_budget = samples_per_sec;
+    }
+}
+
+/* Fold one value into an exponentially weighted mean and variance */
+static void ewma_update(double *mean, double *var, double value) {
+    double diff = value - *mean;
+    double step = ADAPTIVE_ALPHA * diff;
+    
+    *mean += step;
+    *var = (1.0 - ADAPTIVE_ALPHA) * (*var + diff * step);
+}
+
+/* Start the trend of a newly tracked process from its first sample */
+static void start_trend(process_trend_t *trend, const process_info_t *info, double now) {
+    memset(trend, 0, sizeof(*trend));
+    trend->samples = 1;
+    trend->cpu_mean = info->cpu_percent;
+    trend->last_rss = info->rss;
+    trend->last_seen = now;
+}
+
+/* Fold a refresh sample into the trend of its process */
+static void observe_trend(process_trend_t *trend, const process_info_t *info, double now) {
+    double elapsed = now - trend->last_seen;
+    double rss_rate = elapsed > 0 ? labs(info->rss - trend->last_rss) / elapsed : 0.0;
+    
+    ewma_update(&trend->cpu_mean, &trend->cpu_var, info->cpu_percent);
+    ewma_update(&trend->rss_mean, &trend->rss_var, rss_rate);
+    trend->last_rss = info->rss;
+    trend->last_seen = now;
+    trend->samples++;
+}
+
+/* Factor every interval is stretched by while the policies ask for more than the budget */
+static double budget_stretch(void) {
+    return demand > sample_budget ? demand / sample_budget : 1.0;
+}
+
+/*
+ * Interval until the next refresh of a tracked process: the policy's
+ * choice, bounded, then stretched to fit the budget. Updates the demand
+ * (caller holds sched_lock).
+ */
+static double next_interval(tracked_process_t *entry, const process_info_t *info) {
+    double interval = policy->interval(&entry->trend, info);
+    
+    if (interval < SCHEDULER_MIN_INTERVAL) interval = SCHEDULER_MIN_INTERVAL;
+    if (interval > SCHEDULER_MAX_INTERVAL) interval = SCHEDULER_MAX_INTERVAL;
+    
+    demand += 1.0 / interval - entry->rate;
+    entry->rate = 1.0 / interval;
+    return interval * budget_stretch();
+}
+
+/* Add the tokens earned since the last refill (caller holds sched_lock) */
+static void refill_tokens(double now) {
+    double burst = sample_budget * SCHEDULER_BURST_SECS;
+    
+    if (burst < 1.0) burst = 1.0;
+    tokens += (now - tokens_at) * sample_budget;
+    if (tokens > burst) tokens = burst;
+    tokens_at = now;
+}
+
+/* Swap two heap timers */
+static void swap_timers(int a, int b) {
+    refresh_timer_t tmp = timers[a];
+    timers[a] = timers[b];
+    timers[b] = tmp;
+}
+
+/* Queue a timer (caller holds sched_lock); -1 when out of memory */
+static int push_timer(double deadline, pid_t pid, unsigned long long starttime) {
+    if (timer_count == timer_capacity) {
+        int new_capacity = timer_capacity ? timer_capacity * 2 : 1024;
+        refresh_timer_t *grown = (refresh_timer_t*)realloc(timers, new_capacity * sizeof(refresh_timer_t));
+        if (grown == NULL) return -1;
+        timers = grown;
+        timer_capacity = new_capacity;
+    }
+    
+    int i = timer_count++;
+    timers[i].deadline = deadline;
+    timers[i].pid = pid;
+    timers[i].starttime = starttime;
+    
+    while (i > 0 && timers[(i - 1) / 2].deadline > timers[i].deadline) {
+        swap_timers(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    return 0;
+}
+
+/* Remove the earliest timer (caller holds sched_lock and checked timer_count) */
+static refresh_timer_t pop_timer(void) {
+    refresh_timer_t top = timers[0];
+    int i = 0;
+    
+    timers[0] = timers[--timer_count];
+    for (;;) {
+        int earliest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        
+        if (left < timer_count && timers[left].deadline < timers[earliest].deadline) earliest = left;
+        if (right < timer_count && timers[right].deadline < timers[earliest].deadline) earliest = right;
+        if (earliest == i) break;
+        swap_timers(i, earliest);
+        i = earliest;
+    }
+    return top;
+}
+
+/* Link of the tracked entry of a PID, or of the list end (caller holds sched_lock) */
+static tracked_process_t** find_tracked(pid_t pid) {
+    tracked_process_t **link = &tracked[pid & (SCHEDULER_BUCKETS - 1)];
+    
+    while (*link != NULL && (*link)->pid != pid) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/* Stop tracking a PID (caller holds sched_lock) */
+static void untrack(pid_t pid) {
+    tracked_process_t **link = find_tracked(pid);
+    tracked_process_t *entry = *link;
+    
+    if (entry != NULL) {
+        *link = entry->next;
+        demand -= entry->rate;
+        free(entry);
+        
+        /* Keep rounding error from building up */
+        if (--tracked_count == 0) demand = 0.0;
+    }
+}
+
+/* Set the refresh worker count (0 for the default) and CPU pinning, before init_scheduler() */
+void set_scheduler_workers(int workers, int pin) {
+    if (workers > SCHEDULER_MAX_WORKERS) workers = SCHEDULER_MAX_WORKERS;
+    requested_workers = workers > 0 ? workers : 0;
+    pin_workers = pin;
+}
+
+/* Count one refresh's lag behind its deadline (caller holds sched_lock) */
+static void record_lag(double lag) {
+    unsigned long long ns = lag > 0 ? (unsigned long long)(lag * 1e9) : 0;
+    unsigned long long us = ns / 1000;
+    int bucket = 0;
+    
+    while (bucket < SCHEDULER_LAG_BUCKETS - 1 && us >= (1ULL << bucket)) {
+        bucket++;
+    }
+    lag_buckets[bucket]++;
+    if (ns > max_lag_ns) max_lag_ns = ns;
+    if (lag > SCHEDULER_MISS_SECS) missed++;
+}
+
+/*
+ * Lag in seconds that the given fraction of refreshes stayed within, from
+ * the histogram: exact to a power of two, and never above the maximum.
+ * 0 before any refresh.
+ */
+double scheduler_lag_percentile(const scheduler_stats_t *stats, double fraction) {
+    unsigned long long total = 0;
+    unsigned long long seen = 0;
+    double max_lag = stats->max_lag_ns / 1e9;
+    
+    for (int b = 0; b < SCHEDULER_LAG_BUCKETS; b++) {
+        total += stats->lag_buckets[b];
+    }
+    if (total == 0) return 0.0;
+    
+    for (int b = 0; b < SCHEDULER_LAG_BUCKETS - 1; b++) {
+        seen += stats->lag_buckets[b];
+        if (seen >= fraction * total) {
+            double bound = (double)(1ULL << b) / 1e6;
+            return bound < max_lag ? bound : max_lag;
+        }
+    }
+    return max_lag;
+}
+
+/* Publish the scheduler counters in the segment (caller holds sched_lock) */
+static void publish_stats(process_table_t *table) {
+    scheduler_stats_t *stats = &table->scheduler_stats;
+    
+    stats->budget = sample_budget;
+    stats->demand = demand;
+    stats->stretch = budget_stretch();
+    stats->samples = samples_taken;
+    stats->tracked = tracked_count;
+    stats->workers = num_workers;
+    stats->pinned = pin_workers;
+    stats->steals = steals;
+    stats->missed = missed;
+    stats->max_lag_ns = max_lag_ns;
+    memcpy(stats->lag_buckets, lag_buckets, sizeof(lag_buckets));
+}
+
+/* Queue a timer and wake the dispatcher if it is the new earliest (caller holds sched_lock) */
+static int queue_timer(double deadline, pid_t pid, unsigned long long starttime) {
+    if (push_timer(deadline, pid, starttime) != 0) {
+        return -1;
+    }
+    if (timers[0].pid == pid && timers[0].deadline == deadline) {
+        /* The dispatcher is sleeping until a later deadline */
+        pthread_cond_signal(&sched_wake);
+    }
+    return 0;
+}
+
+/*
+ * Start scheduling refreshes of a process just stored in the table. Called
+ * from every insertion site; an identity already tracked costs one hash
+ * lookup. A PID now naming a new process replaces the old identity, whose
+ * timer is discarded when it comes due.
+ */
+void scheduler_track(const process_info_t *info) {
+    tracked_process_t **link;
+    double now;
+    
+    if (!scheduler_running) {
+        return;
+    }
+    
+    pthread_mutex_lock(&sched_lock);
+    
+    link = find_tracked(info->pid);
+    if (*link != NULL && (*link)->starttime == info->starttime) {
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+    if (*link == NULL) {
+        *link = (tracked_process_t*)calloc(1, sizeof(tracked_process_t));
+        if (*link == NULL) {
+            pthread_mutex_unlock(&sched_lock);
+            return;
+        }
+        (*link)->pid = info->pid;
+        tracked_count++;
+    }
+    (*link)->starttime = info->starttime;
+    
+    /* It was sampled just now, so its first refresh is one interval away */
+    now = monotonic_now();
+    start_trend(&(*link)->trend, info, now);
+    if (queue_timer(now + next_interval(*link, info), info->pid, info->starttime) != 0) {
+        untrack(info->pid);
+    }
     
-    table = attach_shared_memory();
-    if (table == NULL) {
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/*
+ * Re-sample one due process into info without touching the table. Returns
+ * 0, or -1 if its PID no longer names the process the timer was set for.
+ */
+static int sample_due(const refresh_timer_t *timer, const system_snapshot_t *sys, process_info_t *info) {
+    /* Hot path: one pread() on the cached stat fd */
+    memset(info, 0, sizeof(*info));
+    if (read_process_stat(timer->pid, sys, info) != 0 || info->starttime != timer->starttime) {
+        return -1;
+    }
+    fill_process_strings(info);
+    update_process_statistics(info, sys);
+    return 0;
+}
+
+/*
+ * Refresh one chunk: sample every process with no lock held, commit the
+ * samples as one batch (each shard they live in is taken once), then fold
+ * them into the trends and queue each again. A process that exited fails
+ * sampling and is untracked. Lag runs from the deadline to the sample.
+ */
+static void refresh_chunk(const refresh_chunk_t *chunk, process_info_t *samples, int stolen) {
+    int sampled = 0;
+    int slots[SCHEDULER_CHUNK];
+    int sample_of[SCHEDULER_CHUNK];
+    double lag[SCHEDULER_CHUNK];
+    double now;
+    
+    for (int i = 0; i < chunk->count; i++) {
+        lag[i] = monotonic_now() - chunk->timers[i].deadline;
+        sample_of[i] = -1;
+        if (sample_due(&chunk->timers[i], &chunk->sys, &samples[sampled]) == 0) {
+            sample_of[i] = sampled++;
+        }
+    }
+    commit_processes(sched_table, samples, sampled, 0, slots);
+    
+    pthread_mutex_lock(&sched_lock);
+    
+    now = monotonic_now();
+    samples_taken += sampled;
+    if (stolen) steals++;
+    
+    for (int i = 0; i < chunk->count; i++) {
+        const refresh_timer_t *timer = &chunk->timers[i];
+        int k = sample_of[i];
+        tracked_process_t *entry = *find_tracked(timer->pid);
+        
+        record_lag(lag[i]);
+        
+        /* Re-tracked under a new identity meanwhile: that one has its own timer */
+        if (entry == NULL || entry->starttime != timer->starttime) continue;
+        
+        if (k < 0 || slots[k] < 0) {
+            untrack(timer->pid);
+            continue;
+        }
+        observe_trend(&entry->trend, &samples[k], now);
+        if (queue_timer(now + next_interval(entry, &samples[k]), timer->pid, timer->starttime) != 0) {
+            untrack(timer->pid);
+        }
+    }
+    
+    publish_stats(sched_table);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+/* Pin the calling worker to the n-th CPU the daemon may run on */
+static void pin_worker(int n) {
+    cpu_set_t allowed, target;
+    int cpus;
+    
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    cpus = CPU_COUNT(&allowed);
+    if (cpus == 0) return;
+    
+    n %= cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || n-- > 0) continue;
+        
+        CPU_ZERO(&target);
+        CPU_SET(cpu, &target);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(target), &target) != 0) {
+            log_message("Could not pin scheduler worker to CPU %d\n", cpu);
+        }
+        return;
+    }
+}
+
+/*
+ * Refresh worker: claims a queued chunk, takes it from its own deque or
+ * steals one from another worker's, and refreshes it.
+ */
+static void* refresh_worker(void *arg) {
+    int self = (int)(long)arg;
+    process_info_t *samples;
+    work_chunk_t chunk;
+    
+    samples = (process_info_t*)malloc(SCHEDULER_CHUNK * sizeof(process_info_t));
+    if (samples == NULL) {
         return NULL;
     }
+    if (pin_workers) {
+        pin_worker(self);
+    }
+    
+    pthread_mutex_lock(&pool_lock);
     
-    /* Initialize update times */
-    time_t now = time(NULL);
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        last_update[i] = now;
-        priorities[i] = PRIORITY_LOW;
-        update_intervals[i] = 5;
+    while (scheduler_running) {
+        if (queued_chunks == 0) {
+            pthread_cond_wait(&work_ready, &pool_lock);
+            continue;
+        }
+        queued_chunks--;
+        pthread_mutex_unlock(&pool_lock);
+        
+        /* A claim is backed by a pushed chunk; another claimant may just be taking a nearer one */
+        int found;
+        while ((found = find_work(worker_deques, num_workers, self, &chunk)) == 0) {
+            sched_yield();
+        }
+        refresh_chunk((const refresh_chunk_t*)chunk.batch, samples, found == 2);
+        free(chunk.batch);
+        
+        pthread_mutex_lock(&pool_lock);
     }
     
-    log_message("Scheduler thread started\n");
+    pthread_mutex_unlock(&pool_lock);
+    free(samples);
+    return NULL;
+}
+
+/*
+ * Split due timers into chunks, one share per worker, and queue them.
+ * A chunk that cannot be queued is refreshed right here.
+ */
+static void dispatch_due(const refresh_timer_t *due, int count, process_info_t *samples) {
+    refresh_chunk_t local;
+    int per_chunk = (count + num_workers - 1) / num_workers;
+    int queued = 0;
+    
+    if (per_chunk > SCHEDULER_CHUNK) per_chunk = SCHEDULER_CHUNK;
+    read_system_snapshot(&local.sys);
+    
+    for (int i = 0, c = 0; i < count; i += per_chunk, c++) {
+        refresh_chunk_t *copy;
+        work_chunk_t chunk;
+        
+        local.count = count - i < per_chunk ? count - i : per_chunk;
+        memcpy(local.timers, due + i, local.count * sizeof(refresh_timer_t));
+        
+        copy = (refresh_chunk_t*)malloc(sizeof(refresh_chunk_t));
+        if (copy != NULL) {
+            memcpy(copy, &local, sizeof(local));
+            chunk.pids = NULL;
+            chunk.count = local.count;
+            chunk.batch = copy;
+            if (push_work(&worker_deques[c % num_workers], chunk) == 0) {
+                queued++;
+                continue;
+            }
+            free(copy);
+        }
+        refresh_chunk(&local, samples, 0);
+    }
+    
+    if (queued > 0) {
+        pthread_mutex_lock(&pool_lock);
+        queued_chunks += queued;
+        pthread_cond_broadcast(&work_ready);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+/*
+ * Dispatcher thread: sleeps until the earliest refresh deadline, then hands
+ * just the processes that are due, within the sample budget, to the
+ * workers. A tick costs O(due log n) regardless of the table size.
+ */
+void* scheduler_thread(void *arg) {
+    refresh_timer_t *due;
+    process_info_t *samples;
+    (void)arg;
+    
+    due = (refresh_timer_t*)malloc(SCHEDULER_BATCH * sizeof(refresh_timer_t));
+    samples = (process_info_t*)malloc(SCHEDULER_CHUNK * sizeof(process_info_t));
+    if (due == NULL || samples == NULL) {
+        free(due);
+        free(samples);
+        return NULL;
+    }
+    
+    log_message("Scheduler thread started (%s policy, %.0f samples/s, %d workers%s)\n",
+                policy->name, sample_budget, num_workers, pin_workers ? " pinned" : "");
+    
+    pthread_mutex_lock(&sched_lock);
+    
+    snprintf(sched_table->scheduler_stats.policy, sizeof(sched_table->scheduler_stats.policy), "%s", policy->name);
+    tokens_at = monotonic_now();
     
     while (scheduler_running) {
-        sleep(1);  /* Check every second */
+        double now = monotonic_now();
         
-        lock_table();
+        publish_stats(sched_table);
+        refill_tokens(now);
         
-        for (int i = 0; i < table->count; i++) {
-            process_info_t *proc = &table->processes[i];
-            
-            if (proc->pid == 0) continue;
-            
-            /* Determine priority based on CPU usage */
-            priorities[i] = get_update_priority(proc->pid, proc->cpu_percent);
-            update_intervals[i] = get_update_interval(priorities[i]);
+        if (timer_count == 0 || timers[0].deadline > now || tokens < 1.0) {
+            /* Wake at the earliest deadline, the next token, a new earlier deadline, or shutdown */
+            double wake = timer_count == 0 ? now + 1.0 : timers[0].deadline;
+            if (wake <= now) wake = now + (1.0 - tokens) / sample_budget;
+            struct timespec deadline;
+            deadline.tv_sec = (time_t)wake;
+            deadline.tv_nsec = (long)((wake - (double)deadline.tv_sec) * 1e9);
+            pthread_cond_timedwait(&sched_wake, &sched_lock, &deadline);
+            continue;
+        }
+        
+        /* Take a batch of due timers the budget allows, skipping ones left by a replaced identity */
+        int allowed = tokens < SCHEDULER_BATCH ? (int)tokens : SCHEDULER_BATCH;
+        int count = 0;
+        while (count < allowed && timer_count > 0 && timers[0].deadline <= now) {
+            refresh_timer_t timer = pop_timer();
+            tracked_process_t *entry = *find_tracked(timer.pid);
             
-            /* Check if it's time to update this process */
-            time_t current_time = time(NULL);
-            if (current_time - last_update[i] >= update_intervals[i]) {
-                /* Trigger update by collecting process info */
-                process_info_t info;
-                memset(&info, 0, sizeof(info));
-                info.pid = proc->pid;
-                
-                if (read_process_stat(proc->pid, &info) == 0) {
-                    read_process_status(proc->pid, &info);
-                    read_process_cmdline(proc->pid, info.cmdline, sizeof(info.cmdline));
-                    update_process_statistics(&info);
-                    
-                    /* Update in table */
-                    update_process_info(table, i, &info);
-                    last_update[i] = current_time;
-                }
+            if (entry != NULL && entry->starttime == timer.starttime) {
+                due[count++] = timer;
             }
         }
+        tokens -= count;
         
-        unlock_table();
+        pthread_mutex_unlock(&sched_lock);
+        
+        if (count > 0) {
+            dispatch_due(due, count, samples);
+        }
+        
+        pthread_mutex_lock(&sched_lock);
     }
     
+    pthread_mutex_unlock(&sched_lock);
+    
+    free(due);
+    free(samples);
     log_message("Scheduler thread stopped\n");
     return NULL;
 }
 
-/* Initialize scheduler */
+/* Stop and join the refresh workers, dropping chunks still queued */
+static void stop_workers(void) {
+    work_chunk_t chunk;
+    
+    pthread_mutex_lock(&pool_lock);
+    scheduler_running = 0;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+    
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(worker_tids[i], NULL);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        while (pop_work(&worker_deques[i], &chunk)) {
+            free(chunk.batch);
+        }
+        destroy_work_deque(&worker_deques[i]);
+    }
+    
+    free(worker_tids);
+    free(worker_deques);
+    worker_tids = NULL;
+    worker_deques = NULL;
+    num_workers = 0;
+    queued_chunks = 0;
+}
+
+/* Initialize scheduler: the refresh workers, then the dispatcher */
 void init_scheduler(void) {
+    pthread_condattr_t attr;
+    long cpus;
+    
     if (scheduler_running) {
         return;
     }
     
+    sched_table = attach_shared_memory();
+    if (sched_table == NULL) {
+        return;
+    }
+    
+    num_workers = requested_workers;
+    if (num_workers == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cpus > 0 && cpus < SCHEDULER_DEFAULT_WORKERS ? (int)cpus : SCHEDULER_DEFAULT_WORKERS;
+    }
+    
+    worker_tids = (pthread_t*)malloc(num_workers * sizeof(pthread_t));
+    worker_deques = (work_deque_t*)malloc(num_workers * sizeof(work_deque_t));
+    if (worker_tids == NULL || worker_deques == NULL) {
+        free(worker_tids);
+        free(worker_deques);
+        worker_tids = NULL;
+        worker_deques = NULL;
+        return;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        if (init_work_deque(&worker_deques[i], 16) != 0) {
+            /* Fewer workers; each has a deque */
+            num_workers = i;
+            break;
+        }
+    }
+    if (num_workers == 0) {
+        free(worker_tids);
+        free(worker_deques);
+        worker_tids = NULL;
+        worker_deques = NULL;
+        return;
+    }
+    
+    /* Deadlines are monotonic, so the wait must be too */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched_wake, &attr);
+    pthread_condattr_destroy(&attr);
+    
     scheduler_running = 1;
     
-    if (pthread_create(&scheduler_tid, NULL, scheduler_thread, NULL) != 0) {
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&worker_tids[i], NULL, refresh_worker, (void*)(long)i) != 0) {
+            perror("pthread_create scheduler worker");
+            /* Chunks only go to the deques of running workers */
+            for (int j = i; j < num_workers; j++) {
+                destroy_work_deque(&worker_deques[j]);
+            }
+            num_workers = i;
+            break;
+        }
+    }
+    
+    if (num_workers == 0 || pthread_create(&scheduler_tid, NULL, scheduler_thread, NULL) != 0) {
         perror("pthread_create scheduler");
-        scheduler_running = 0;
+        stop_workers();
+        pthread_cond_destroy(&sched_wake);
         return;
     }
     
@@ -118,9 +766,24 @@ void cleanup_scheduler(void) {
         return;
     }
     
+    pthread_mutex_lock(&sched_lock);
     scheduler_running = 0;
+    pthread_cond_signal(&sched_wake);
+    pthread_mutex_unlock(&sched_lock);
+    
     pthread_join(scheduler_tid, NULL);
+    stop_workers();
+    
+    /* Forget every tracked identity */
+    for (int i = 0; i < SCHEDULER_BUCKETS; i++) {
+        while (tracked[i] != NULL) {
+            untrack(tracked[i]->pid);
+        }
+    }
+    free(timers);
+    timers = NULL;
+    timer_count = timer_capacity = 0;
+    pthread_cond_destroy(&sched_wake);
     
     log_message("Scheduler cleaned up\n");
 }
-
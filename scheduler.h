@@ -3,12 +3,44 @@
 
 #include "common.h"
 
+#define SCHEDULER_BUCKETS 4096      /* Tracked-identity hash buckets (power of two) */
+#define SCHEDULER_BATCH 256         /* Due refreshes taken off the heap at once */
+#define SCHEDULER_MIN_INTERVAL 0.1  /* Seconds between refreshes of the busiest process */
+#define SCHEDULER_MAX_INTERVAL 30.0 /* Seconds between refreshes of an idle process */
+#define SCHEDULER_DEFAULT_BUDGET 2000.0  /* Refresh samples per second, all processes */
+#define SCHEDULER_BURST_SECS 0.1    /* Budget that may be spent at once after idling */
+#define SCHEDULER_CHUNK 32          /* Most due refreshes handed to a worker at once */
+#define SCHEDULER_DEFAULT_WORKERS 4 /* Refresh workers, at most one per online CPU */
+#define SCHEDULER_MAX_WORKERS 64
+#define SCHEDULER_MISS_SECS 0.05    /* Lag past a deadline that counts as a miss */
+
+/* What the scheduler has learned about one process from its refreshes */
+typedef struct {
+    int samples;              /* Observations so far */
+    double cpu_mean;          /* EWMA of CPU percent */
+    double cpu_var;           /* EWMA variance of CPU percent */
+    double rss_mean;          /* EWMA of |RSS change| in KB per second */
+    double rss_var;
+    long last_rss;            /* KB at the previous observation */
+    double last_seen;         /* CLOCK_MONOTONIC seconds of the previous observation */
+} process_trend_t;
+
+/* Priority Policy: picks the interval until a process's next refresh */
+typedef struct {
+    const char *name;
+    double (*interval)(const process_trend_t *trend, const process_info_t *info);
+} priority_policy_t;
+
 /* Scheduler Functions */
 void init_scheduler(void);
 void cleanup_scheduler(void);
+void scheduler_track(const process_info_t *info);
+int set_priority_policy(const char *name);
+void set_sample_budget(double samples_per_sec);
+void set_scheduler_workers(int workers, int pin);
+double scheduler_lag_percentile(const scheduler_stats_t *stats, double fraction);
 priority_level_t get_update_priority(pid_t pid, double cpu_usage);
 int get_update_interval(priority_level_t priority);
 void* scheduler_thread(void *arg);
 
 #endif /* SCHEDULER_H */
-
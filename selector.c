@@ -0,0 +1,394 @@
+#include "selector.h"
+#include "process_table.h"
+#include "string_arena.h"
+#include "logger.h"
+#include "pidfd_watch.h"
+#include <regex.h>
+#include <pwd.h>
+
+static const char *selector_words[] = { "name", "cmd", "uid", "ppid", "tree" };
+
+/* Parent/child pair for subtree walks */
+typedef struct {
+    pid_t ppid;
+    pid_t pid;
+} process_edge_t;
+
+/* Selector named by a command-line word; -1 if unknown */
+int parse_selector(const char *word, selector_t *selector) {
+    for (int i = 0; i < (int)(sizeof(selector_words) / sizeof(selector_words[0])); i++) {
+        if (strcmp(word, selector_words[i]) == 0) {
+            *selector = (selector_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Append a PID, growing the array; returns the new count (unchanged when out of memory) */
+static int push_pid(pid_t **pids, int *capacity, int count, pid_t pid) {
+    if (count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        pid_t *grown = (pid_t*)realloc(*pids, new_capacity * sizeof(pid_t));
+        if (grown == NULL) return count;
+        *pids = grown;
+        *capacity = new_capacity;
+    }
+    (*pids)[count] = pid;
+    return count + 1;
+}
+
+/* Parse a positive PID argument; -1 if it is not one */
+static pid_t parse_pid(const char *argument) {
+    char *end;
+    long value = strtol(argument, &end, 10);
+    
+    return (*argument != '\0' && *end == '\0' && value > 0 && value <= 0x7fffffff) ? (pid_t)value : -1;
+}
+
+/* Compare PIDs for qsort/bsearch */
+static int compare_pids(const void *a, const void *b) {
+    pid_t pa = *(const pid_t*)a;
+    pid_t pb = *(const pid_t*)b;
+    return (pa > pb) - (pa < pb);
+}
+
+/* Order edges by parent, then child */
+static int compare_edges(const void *a, const void *b) {
+    const process_edge_t *ea = (const process_edge_t*)a;
+    const process_edge_t *eb = (const process_edge_t*)b;
+    
+    if (ea->ppid != eb->ppid) return (ea->ppid > eb->ppid) - (ea->ppid < eb->ppid);
+    return (ea->pid > eb->pid) - (ea->pid < eb->pid);
+}
+
+/* First edge whose parent is ppid (edges sorted by parent), or count if none */
+static int first_child(const process_edge_t *edges, int count, pid_t ppid) {
+    int lo = 0, hi = count;
+    
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (edges[mid].ppid < ppid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Breadth-first walk of a subtree over the snapshot's parent links, so
+ * parents always come before their children. Returns the count.
+ */
+static int select_subtree(process_table_t *snapshot, pid_t root, pid_t **pids, int *capacity) {
+    process_edge_t *edges;
+    int edge_count = 0, count = 0;
+    
+    edges = (process_edge_t*)malloc((snapshot->count > 0 ? snapshot->count : 1) * sizeof(process_edge_t));
+    if (edges == NULL) return 0;
+    
+    int found = 0;
+    for (int i = 0; i < snapshot->count; i++) {
+        pid_t pid = table_pid(snapshot, i);
+        if (pid == 0) continue;
+        if (pid == root) found = 1;
+        edges[edge_count].ppid = table_ppid(snapshot, i);
+        edges[edge_count].pid = pid;
+        edge_count++;
+    }
+    qsort(edges, edge_count, sizeof(process_edge_t), compare_edges);
+    
+    if (found) {
+        count = push_pid(pids, capacity, count, root);
+    }
+    
+    /* The list is its own queue; bounded so stale links cannot cycle */
+    for (int i = 0; i < count && count <= edge_count; i++) {
+        for (int e = first_child(edges, edge_count, (*pids)[i]);
+             e < edge_count && edges[e].ppid == (*pids)[i] && count <= edge_count; e++) {
+            if (edges[e].pid != root) {
+                count = push_pid(pids, capacity, count, edges[e].pid);
+            }
+        }
+    }
+    
+    free(edges);
+    return count;
+}
+
+/*
+ * Resolve a selector against a table snapshot into *pids. Names compare as
+ * interned string references; patterns run on the full command line.
+ * Returns the count, or -1 with a message in error if the argument is bad.
+ */
+int select_processes(process_table_t *snapshot, selector_t selector, const char *argument,
+                     pid_t **pids, int *capacity, char *error, size_t error_len) {
+    process_info_t info;
+    int count = 0;
+    
+    switch (selector) {
+        case SELECT_NAME: {
+            arena_ref_t name = arena_find(argument, strlen(argument));
+            
+            if (name == 0) return 0;  /* No process has ever had this name */
+            for (int i = 0; i < snapshot->count; i++) {
+                if (table_pid(snapshot, i) != 0 && table_name_ref(snapshot, i) == name) {
+                    count = push_pid(pids, capacity, count, table_pid(snapshot, i));
+                }
+            }
+            return count;
+        }
+        
+        case SELECT_CMDLINE: {
+            regex_t regex;
+            char *cmdline = NULL;
+            size_t cmdline_size = 0;
+            int rc = regcomp(&regex, argument, REG_EXTENDED | REG_NOSUB);
+            
+            if (rc != 0) {
+                regerror(rc, &regex, error, error_len);
+                return -1;
+            }
+            for (int i = 0; i < snapshot->count; i++) {
+                if (table_pid(snapshot, i) == 0) continue;
+                
+                table_get_info(snapshot, i, &info);
+                size_t length = arena_length(info.cmdline_ref);
+                if (length + 1 > cmdline_size) {
+                    char *grown = (char*)realloc(cmdline, length + 1);
+                    if (grown == NULL) continue;
+                    cmdline = grown;
+                    cmdline_size = length + 1;
+                }
+                arena_copy(info.cmdline_ref, cmdline, cmdline_size);
+                if (regexec(&regex, cmdline, 0, NULL, 0) == 0) {
+                    count = push_pid(pids, capacity, count, info.pid);
+                }
+            }
+            free(cmdline);
+            regfree(&regex);
+            return count;
+        }
+        
+        case SELECT_UID: {
+            char *end;
+            long uid = strtol(argument, &end, 10);
+            
+            if (*argument == '\0' || *end != '\0') {
+                struct passwd *pw = getpwnam(argument);
+                if (pw == NULL) {
+                    snprintf(error, error_len, "Unknown user: %s", argument);
+                    return -1;
+                }
+                uid = pw->pw_uid;
+            }
+            for (int i = 0; i < snapshot->count; i++) {
+                if (table_pid(snapshot, i) == 0) continue;
+                
+                table_get_info(snapshot, i, &info);
+                if (info.uid == (uid_t)uid) {
+                    count = push_pid(pids, capacity, count, info.pid);
+                }
+            }
+            return count;
+        }
+        
+        case SELECT_PPID:
+        case SELECT_SUBTREE: {
+            pid_t pid = parse_pid(argument);
+            
+            if (pid < 0) {
+                snprintf(error, error_len, "Invalid PID: %s", argument);
+                return -1;
+            }
+            if (selector == SELECT_SUBTREE) {
+                return select_subtree(snapshot, pid, pids, capacity);
+            }
+            for (int i = 0; i < snapshot->count; i++) {
+                if (table_pid(snapshot, i) != 0 && table_ppid(snapshot, i) == pid) {
+                    count = push_pid(pids, capacity, count, table_pid(snapshot, i));
+                }
+            }
+            return count;
+        }
+    }
+    
+    snprintf(error, error_len, "Unknown selector");
+    return -1;
+}
+
+/* Signal the process the table holds for pid; 0 or an errno (ESRCH once it left) */
+static int signal_listed(process_table_t *table, pid_t pid, int sig) {
+    process_info_t info;
+    
+    if (get_process(table, pid, &info) != 0) return ESRCH;
+    return signal_process(pid, info.starttime, sig);
+}
+
+/* Neither the daemon nor the requesting client is ever selected */
+static int excluded(const group_signal_t *request, pid_t pid) {
+    return pid == getpid() || pid == request->caller_pid;
+}
+
+/*
+ * Whether the caller could signal pid itself, as kill(2) would allow: a
+ * process of its own uid, or any one for root. PID 1 is never signalled.
+ */
+static int permitted(process_table_t *table, const group_signal_t *request, pid_t pid) {
+    process_info_t info;
+    
+    if (pid == 1 || get_process(table, pid, &info) != 0) return 0;
+    return request->caller_uid == 0 || info.uid == request->caller_uid;
+}
+
+/* Keep the PIDs the caller may signal, in order; counts the others in *skipped */
+static int keep_permitted(process_table_t *table, const group_signal_t *request,
+                          pid_t *pids, int count, int *skipped) {
+    int kept = 0;
+    
+    for (int i = 0; i < count; i++) {
+        if (excluded(request, pids[i])) continue;
+        if (permitted(table, request, pids[i])) {
+            pids[kept++] = pids[i];
+        } else {
+            (*skipped)++;
+        }
+    }
+    return kept;
+}
+
+/*
+ * Freeze a subtree top-down with SIGSTOP, then re-resolve it from a fresh
+ * snapshot until no unfrozen descendant turns up (a child forked before its
+ * parent stopped), at most FREEZE_ROUNDS times. New descendants are
+ * appended, still after their parents. Returns the new count.
+ */
+static int freeze_subtree(process_table_t *table, const group_signal_t *request, pid_t **pids,
+                          int *capacity, int count) {
+    pid_t *fresh = NULL, *sorted = NULL;
+    int fresh_capacity = 0;
+    int frozen = 0;
+    char error[64];
+    
+    for (int round = 0; round < FREEZE_ROUNDS; round++) {
+        int added = 0;
+        
+        for (; frozen < count; frozen++) {
+            signal_listed(table, (*pids)[frozen], SIGSTOP);
+        }
+        
+        /* Give fork events a moment to reach the table */
+        usleep(10000);
+        
+        process_table_t *snapshot = snapshot_table(table);
+        if (snapshot == NULL) break;
+        int fresh_count = select_processes(snapshot, SELECT_SUBTREE, request->argument, &fresh,
+                                           &fresh_capacity, error, sizeof(error));
+        free(snapshot);
+        
+        pid_t *grown = (pid_t*)realloc(sorted, (count > 0 ? count : 1) * sizeof(pid_t));
+        if (grown == NULL) break;
+        sorted = grown;
+        memcpy(sorted, *pids, count * sizeof(pid_t));
+        qsort(sorted, count, sizeof(pid_t), compare_pids);
+        
+        int known = count;
+        for (int i = 0; i < fresh_count; i++) {
+            if (excluded(request, fresh[i]) || !permitted(table, request, fresh[i]) ||
+                bsearch(&fresh[i], sorted, known, sizeof(pid_t), compare_pids) != NULL) {
+                continue;
+            }
+            count = push_pid(pids, capacity, count, fresh[i]);
+            added++;
+        }
+        if (added == 0) break;
+    }
+    
+    free(fresh);
+    free(sorted);
+    return count;
+}
+
+/*
+ * Signal every process a request's selector matches, in one pass over a
+ * lock-free snapshot of the table. Only processes the caller could signal
+ * itself are kept (see permitted()); the rest are counted as skipped. Each
+ * PID's result goes to on_result until one cannot be delivered (the
+ * client stopped reading); the summary counts every PID either way. The
+ * daemon and the requesting client are never selected. A frozen subtree
+ * is signalled bottom-up and then continued, so it handles the signal
+ * without having been able to fork in between. Returns the status for the
+ * final reply.
+ */
+int signal_selected(const group_signal_t *request, signal_result_fn on_result, void *ctx,
+                    char *summary, size_t summary_len) {
+    process_table_t *table = attach_shared_memory();
+    process_table_t *snapshot;
+    pid_t *pids = NULL;
+    int capacity = 0, count, failed = 0, skipped = 0, first_error = 0;
+    int streaming = 1;
+    int sig = request->signal > 0 ? request->signal : SIGTERM;
+    int freeze = request->freeze && request->selector == SELECT_SUBTREE && sig != SIGSTOP;
+    char error[128] = "";
+    
+    snapshot = snapshot_table(table);
+    if (snapshot == NULL) {
+        snprintf(summary, summary_len, "Error: Failed to read process table");
+        return EIO;
+    }
+    count = select_processes(snapshot, request->selector, request->argument, &pids, &capacity,
+                             error, sizeof(error));
+    free(snapshot);
+    
+    if (count < 0) {
+        snprintf(summary, summary_len, "Error: %s", error);
+        free(pids);
+        return EINVAL;
+    }
+    count = keep_permitted(table, request, pids, count, &skipped);
+    
+    if (freeze && count > 0) {
+        count = freeze_subtree(table, request, &pids, &capacity, count);
+    }
+    
+    /* Children before parents, so nothing is reparented mid-pass */
+    for (int i = count - 1; i >= 0; i--) {
+        char result[64];
+        int rc = signal_listed(table, pids[i], sig);
+        
+        if (rc != 0) {
+            failed++;
+            if (first_error == 0) first_error = rc;
+            snprintf(result, sizeof(result), "Error: %s", strerror(rc));
+        } else {
+            snprintf(result, sizeof(result), "Sent signal %d", sig);
+        }
+        if (streaming && on_result(pids[i], rc, result, ctx) != 0) {
+            streaming = 0;
+        }
+    }
+    
+    if (freeze && sig != SIGKILL) {
+        for (int i = 0; i < count; i++) {
+            signal_listed(table, pids[i], SIGCONT);
+        }
+    }
+    free(pids);
+    
+    if (count == 0 && skipped > 0) {
+        snprintf(summary, summary_len, "Error: None of the %d matching processes is PID 1-free and owned by uid %d",
+                 skipped, (int)request->caller_uid);
+        return EPERM;
+    }
+    if (count == 0) {
+        snprintf(summary, summary_len, "Error: No matching processes");
+        return ESRCH;
+    }
+    
+    snprintf(summary, summary_len, "Signalled %d of %d processes with signal %d%s (%d failed, %d skipped)%s",
+             count - failed, count, sig, freeze ? " after freezing the subtree" : "", failed, skipped,
+             streaming ? "" : ", per-process results cut short");
+    log_operation("SIGNAL_GROUP", request->caller_pid, summary);
+    return first_error;
+}
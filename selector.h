@@ -0,0 +1,28 @@
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include "common.h"
+
+#define FREEZE_ROUNDS 4             /* Re-resolutions while freezing a subtree */
+
+/* A group signal and who asked for it */
+typedef struct {
+    selector_t selector;
+    const char *argument;     /* Name, pattern or number */
+    int signal;
+    int freeze;               /* Subtree: SIGSTOP it top-down first */
+    uid_t caller_uid;         /* Only its own processes are signalled, unless 0 */
+    pid_t caller_pid;         /* Never selected */
+} group_signal_t;
+
+/* Called with each PID's result; nonzero when it could not be delivered */
+typedef int (*signal_result_fn)(pid_t pid, int status, const char *result, void *ctx);
+
+/* Selector Functions */
+int parse_selector(const char *word, selector_t *selector);
+int select_processes(process_table_t *snapshot, selector_t selector, const char *argument,
+                     pid_t **pids, int *capacity, char *error, size_t error_len);
+int signal_selected(const group_signal_t *request, signal_result_fn on_result, void *ctx,
+                    char *summary, size_t summary_len);
+
+#endif /* SELECTOR_H */
@@ -2,149 +2,254 @@
 #include <sys/sysinfo.h>
 #include <unistd.h>
 
-static unsigned long last_total_cpu = 0;
-static unsigned long last_idle_cpu = 0;
-static time_t last_update = 0;
-
-/* Read system statistics */
-int read_system_stats(unsigned long *total_cpu_time, unsigned long *idle_time) {
-    FILE *fp = fopen("/proc/stat", "r");
-    if (fp == NULL) {
-        return -1;
-    }
+#define CPU_CACHE_INITIAL 1024      /* Initial slots (power of two) */
+#define CPU_MIN_INTERVAL 0.1        /* Shorter intervals reuse the last value */
+
+/* Previous CPU sample of one process, keyed by (pid, starttime) */
+typedef struct {
+    pid_t pid;                      /* 0 marks an empty slot */
+    unsigned long long starttime;
+    unsigned long ticks;            /* utime + stime at the sample */
+    double timestamp;               /* CLOCK_MONOTONIC seconds */
+    double cpu_percent;             /* Last computed value */
+} cpu_sample_t;
+
+static cpu_sample_t *cpu_cache = NULL;
+static size_t cpu_cache_size = 0;
+static size_t cpu_cache_used = 0;
+static pthread_mutex_t cpu_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get monotonic time in seconds */
+static double monotonic_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Hash a PID into the cache */
+static size_t cpu_cache_slot(pid_t pid, size_t size) {
+    return ((size_t)pid * 2654435761u) & (size - 1);
+}
+
+/* Find the slot holding pid, or the empty slot where it belongs */
+static cpu_sample_t* cpu_cache_find(pid_t pid) {
+    size_t i = cpu_cache_slot(pid, cpu_cache_size);
     
-    unsigned long user, nice, system, idle, iowait, irq, softirq;
-    char line[256];
+    while (cpu_cache[i].pid != 0 && cpu_cache[i].pid != pid) {
+        i = (i + 1) & (cpu_cache_size - 1);
+    }
+    return &cpu_cache[i];
+}
+
+/* Grow the cache so it stays under 70% load */
+static int cpu_cache_reserve(void) {
+    cpu_sample_t *old_cache = cpu_cache;
+    size_t old_size = cpu_cache_size;
+    size_t new_size;
+    
+    if (cpu_cache != NULL && (cpu_cache_used + 1) * 10 < cpu_cache_size * 7) {
+        return 0;
+    }
     
-    if (fgets(line, sizeof(line), fp) == NULL) {
-        fclose(fp);
+    new_size = old_size ? old_size * 2 : CPU_CACHE_INITIAL;
+    cpu_cache = (cpu_sample_t*)calloc(new_size, sizeof(cpu_sample_t));
+    if (cpu_cache == NULL) {
+        cpu_cache = old_cache;
         return -1;
     }
+    cpu_cache_size = new_size;
     
-    sscanf(line, "cpu %lu %lu %lu %lu %lu %lu %lu",
-           &user, &nice, &system, &idle, &iowait, &irq, &softirq);
-    
-    fclose(fp);
-    
-    *total_cpu_time = user + nice + system + idle + iowait + irq + softirq;
-    *idle_time = idle;
-    
+    for (size_t i = 0; i < old_size; i++) {
+        if (old_cache[i].pid != 0) {
+            *cpu_cache_find(old_cache[i].pid) = old_cache[i];
+        }
+    }
+    free(old_cache);
     return 0;
 }
 
-/* Calculate process CPU usage */
-int calculate_process_cpu(pid_t pid, double *cpu_percent) {
-    char stat_path[MAX_PATH_LEN];
-    FILE *fp;
-    unsigned long utime, stime;
-    unsigned long starttime;
-    unsigned long total_time;
-    unsigned long system_uptime = 0;
-    unsigned long total_cpu, idle_cpu;
-    double elapsed_time;
-    double cpu_usage;
-    
-    snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
-    fp = fopen(stat_path, "r");
-    if (fp == NULL) {
-        return -1;
+/* Remove a slot, shifting back later entries of the same probe run */
+static void cpu_cache_delete(size_t hole) {
+    size_t mask = cpu_cache_size - 1;
+    size_t i = hole;
+    
+    for (;;) {
+        i = (i + 1) & mask;
+        if (cpu_cache[i].pid == 0) break;
+        
+        size_t home = cpu_cache_slot(cpu_cache[i].pid, cpu_cache_size);
+        /* Move i into the hole unless its home lies cyclically in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            cpu_cache[hole] = cpu_cache[i];
+            hole = i;
+        }
     }
+    cpu_cache[hole].pid = 0;
+    cpu_cache_used--;
+}
+
+/* Read per-scan system values */
+int read_system_snapshot(system_snapshot_t *sys) {
+    struct sysinfo info;
+    struct timespec ts;
+    long page_size;
     
-    /* Read from /proc/pid/stat */
-    if (fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
-               "%lu %lu %*d %*d %*d %*d %*d %*d %*u %lu",
-               &utime, &stime, &starttime) != 3) {
-        fclose(fp);
-        return -1;
-    }
-    fclose(fp);
+    if (sys == NULL) return -1;
     
-    /* Read system uptime */
-    fp = fopen("/proc/uptime", "r");
-    if (fp != NULL) {
-        fscanf(fp, "%lu", &system_uptime);
-        fclose(fp);
+    sys->clk_tck = sysconf(_SC_CLK_TCK);
+    if (sys->clk_tck <= 0) {
+        sys->clk_tck = 100;
     }
     
-    /* Get total CPU time */
-    if (read_system_stats(&total_cpu, &idle_cpu) != 0) {
-        return -1;
+    sys->ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (sys->ncpus <= 0) {
+        sys->ncpus = 1;
     }
     
-    total_time = utime + stime;
-    elapsed_time = system_uptime - (starttime / sysconf(_SC_CLK_TCK));
+    page_size = sysconf(_SC_PAGESIZE);
+    sys->page_size_kb = page_size > 0 ? page_size / 1024 : 4;
     
-    if (elapsed_time <= 0) {
-        elapsed_time = 1.0;
+    if (sysinfo(&info) != 0) {
+        return -1;
     }
+    sys->total_ram_kb = (unsigned long)info.totalram * info.mem_unit / 1024;
     
-    /* Calculate CPU percentage */
-    cpu_usage = ((double)total_time / sysconf(_SC_CLK_TCK)) / elapsed_time * 100.0;
-    
-    if (cpu_usage > 100.0) {
-        cpu_usage = 100.0;
+    /* CLOCK_BOOTTIME is what /proc/uptime reports, without the file read */
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
+        sys->uptime = ts.tv_sec + ts.tv_nsec / 1e9;
+    } else {
+        sys->uptime = (double)info.uptime;
     }
     
-    *cpu_percent = cpu_usage;
     return 0;
 }
 
-/* Get CPU usage for a process */
-double get_cpu_usage(pid_t pid) {
-    double cpu_percent = 0.0;
-    calculate_process_cpu(pid, &cpu_percent);
-    return cpu_percent;
+/* Lifetime-average CPU usage, used until a process has a previous sample */
+static double lifetime_process_cpu(const process_info_t *info, const system_snapshot_t *sys) {
+    double total_time;
+    double elapsed_time;
+    
+    total_time = (double)(info->utime + info->stime) / sys->clk_tck;
+    elapsed_time = sys->uptime - (double)info->starttime / sys->clk_tck;
+    
+    if (elapsed_time <= 0) {
+        elapsed_time = 1.0;
+    }
+    
+    return total_time / elapsed_time * 100.0;
 }
 
-/* Get memory usage for a process */
-double get_memory_usage(pid_t pid) {
-    char stat_path[MAX_PATH_LEN];
-    FILE *fp;
-    unsigned long vsize;
-    long rss;
-    struct sysinfo info;
-    double mem_percent;
+/* Calculate process CPU usage over the interval since its previous sample */
+double calculate_process_cpu(const process_info_t *info, const system_snapshot_t *sys) {
+    unsigned long ticks = info->utime + info->stime;
+    double now = monotonic_now();
+    double cpu_usage;
+    cpu_sample_t *prev;
     
-    snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
-    fp = fopen(stat_path, "r");
-    if (fp == NULL) {
-        return 0.0;
+    pthread_mutex_lock(&cpu_cache_lock);
+    
+    if (cpu_cache_reserve() != 0) {
+        pthread_mutex_unlock(&cpu_cache_lock);
+        return lifetime_process_cpu(info, sys);
     }
     
-    /* Read vsize and rss from /proc/pid/stat */
-    if (fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
-               "%*u %*u %*d %*d %*d %*d %*d %*d %*u %*u %lu %ld",
-               &vsize, &rss) != 2) {
-        fclose(fp);
-        return 0.0;
+    prev = cpu_cache_find(info->pid);
+    
+    if (prev->pid == info->pid && prev->starttime == info->starttime) {
+        double elapsed_time = now - prev->timestamp;
+        
+        if (elapsed_time < CPU_MIN_INTERVAL) {
+            /* Too close to the last sample to measure; keep its baseline */
+            cpu_usage = prev->cpu_percent;
+            pthread_mutex_unlock(&cpu_cache_lock);
+            return cpu_usage;
+        }
+        
+        if (ticks >= prev->ticks) {
+            cpu_usage = (double)(ticks - prev->ticks) / sys->clk_tck / elapsed_time * 100.0;
+        } else {
+            cpu_usage = 0.0;
+        }
+    } else {
+        /* First sight, or the PID was reused by a new process */
+        if (prev->pid == 0) {
+            cpu_cache_used++;
+        }
+        cpu_usage = lifetime_process_cpu(info, sys);
     }
-    fclose(fp);
     
-    /* Get total system memory */
-    if (sysinfo(&info) != 0) {
-        return 0.0;
+    /* A process can use at most every CPU */
+    if (cpu_usage > 100.0 * sys->ncpus) {
+        cpu_usage = 100.0 * sys->ncpus;
     }
     
-    /* Calculate memory percentage (rss is in pages) */
-    long page_size = sysconf(_SC_PAGESIZE);
-    long total_mem_kb = info.totalram * (info.mem_unit / 1024);
-    long process_mem_kb = rss * (page_size / 1024);
+    prev->pid = info->pid;
+    prev->starttime = info->starttime;
+    prev->ticks = ticks;
+    prev->timestamp = now;
+    prev->cpu_percent = cpu_usage;
     
-    if (total_mem_kb > 0) {
-        mem_percent = ((double)process_mem_kb / total_mem_kb) * 100.0;
-    } else {
-        mem_percent = 0.0;
+    pthread_mutex_unlock(&cpu_cache_lock);
+    return cpu_usage;
+}
+
+/* Calculate process memory usage from already sampled RSS */
+double calculate_process_mem(const process_info_t *info, const system_snapshot_t *sys) {
+    if (sys->total_ram_kb == 0) {
+        return 0.0;
     }
     
-    return mem_percent;
+    return ((double)info->rss / sys->total_ram_kb) * 100.0;
 }
 
 /* Update process statistics */
-void update_process_statistics(process_info_t *info) {
-    if (info == NULL) return;
+void update_process_statistics(process_info_t *info, const system_snapshot_t *sys) {
+    if (info == NULL || sys == NULL) return;
     
-    info->cpu_percent = get_cpu_usage(info->pid);
-    info->mem_percent = get_memory_usage(info->pid);
+    info->cpu_percent = calculate_process_cpu(info, sys);
+    info->mem_percent = calculate_process_mem(info, sys);
     info->last_update = time(NULL);
 }
 
+/* Drop the previous sample of an exited process */
+void forget_cpu_sample(pid_t pid) {
+    pthread_mutex_lock(&cpu_cache_lock);
+    
+    if (cpu_cache != NULL) {
+        cpu_sample_t *prev = cpu_cache_find(pid);
+        if (prev->pid == pid) {
+            cpu_cache_delete((size_t)(prev - cpu_cache));
+        }
+    }
+    
+    pthread_mutex_unlock(&cpu_cache_lock);
+}
+
+/* Drop samples of processes not seen for max_age seconds */
+void prune_cpu_samples(double max_age) {
+    double now = monotonic_now();
+    size_t i = 0;
+    
+    pthread_mutex_lock(&cpu_cache_lock);
+    
+    while (i < cpu_cache_size) {
+        if (cpu_cache[i].pid != 0 && now - cpu_cache[i].timestamp > max_age) {
+            /* Deleting may shift a later entry into i, so re-check it */
+            cpu_cache_delete(i);
+        } else {
+            i++;
+        }
+    }
+    
+    pthread_mutex_unlock(&cpu_cache_lock);
+}
+
+/* Free the sample cache */
+void cleanup_cpu_samples(void) {
+    pthread_mutex_lock(&cpu_cache_lock);
+    free(cpu_cache);
+    cpu_cache = NULL;
+    cpu_cache_size = 0;
+    cpu_cache_used = 0;
+    pthread_mutex_unlock(&cpu_cache_lock);
+}
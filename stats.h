@@ -3,12 +3,17 @@
 
 #include "common.h"
 
+#define CPU_SAMPLE_MAX_AGE 60.0     /* Seconds before an unseen sample is dropped (> longest refresh interval) */
+
 /* Statistics Functions */
-double get_cpu_usage(pid_t pid);
-double get_memory_usage(pid_t pid);
-int read_system_stats(unsigned long *total_cpu_time, unsigned long *idle_time);
-int calculate_process_cpu(pid_t pid, double *cpu_percent);
-void update_process_statistics(process_info_t *info);
+int read_system_snapshot(system_snapshot_t *sys);
+double calculate_process_cpu(const process_info_t *info, const system_snapshot_t *sys);
+double calculate_process_mem(const process_info_t *info, const system_snapshot_t *sys);
+void update_process_statistics(process_info_t *info, const system_snapshot_t *sys);
 
-#endif /* STATS_H */
+/* CPU Sample Cache Functions */
+void forget_cpu_sample(pid_t pid);
+void prune_cpu_samples(double max_age);
+void cleanup_cpu_samples(void);
 
+#endif /* STATS_H */
@@ -0,0 +1,485 @@
+#include "string_arena.h"
+#include "logger.h"
+#include <sys/stat.h>
+
+#define ARENA_BUCKETS 32768         /* Intern hash buckets (power of two) */
+#define ARENA_CLASSES 16            /* Block sizes 64 << class, up to 2 MiB */
+#define ARENA_MIN_BLOCK 64
+
+/*
+ * Arena Header (at the start of the object). Blocks follow it; a string is
+ * referenced by the offset of its block, which stays valid as the object
+ * grows. Freed blocks queue per size class and are reused oldest first once
+ * ARENA_REUSE_DELAY has passed, so a lock-free reader holding a stale
+ * reference still finds readable memory.
+ */
+typedef struct {
+    int active;
+    pthread_mutex_t lock;           /* Process-shared, robust */
+    size_t size;                    /* Bytes handed out (blocks end here) */
+    size_t file_size;               /* Bytes backed by the object */
+    unsigned long next_stamp;
+    arena_ref_t free_head[ARENA_CLASSES];
+    arena_ref_t free_tail[ARENA_CLASSES];
+    unsigned long strings;
+    unsigned long live_bytes;
+    unsigned long intern_calls;
+    unsigned long intern_hits;
+    arena_ref_t buckets[ARENA_BUCKETS];
+} arena_header_t;
+
+/* One interned string */
+typedef struct {
+    unsigned int refs;              /* Table entries and cache entries using it */
+    unsigned int hash;
+    unsigned int length;            /* Bytes, excluding the terminating NUL */
+    unsigned int size_class;
+    unsigned long stamp;            /* Unique per allocation: tells reuse apart */
+    arena_ref_t next;               /* Hash chain while live, free queue after */
+    double freed_at;                /* CLOCK_MONOTONIC seconds */
+    char data[];
+} arena_block_t;
+
+static int arena_fd = -1;
+static arena_header_t *arena = NULL;
+static size_t arena_mapped = 0;
+static pthread_mutex_t arena_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get monotonic time in seconds (system-wide, comparable across processes) */
+static double monotonic_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Offset of the first block */
+static size_t blocks_start(void) {
+    return (sizeof(arena_header_t) + ARENA_MIN_BLOCK - 1) & ~(size_t)(ARENA_MIN_BLOCK - 1);
+}
+
+/* Block behind a reference */
+static arena_block_t* block_at(arena_ref_t ref) {
+    return (arena_block_t*)((char*)arena + ref);
+}
+
+/* Map the first size bytes of the object into this process, within the reservation */
+static int arena_map_to(size_t size) {
+    int result = 0;
+    
+    if (size <= __atomic_load_n(&arena_mapped, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&arena_map_lock);
+    
+    size = (size + (size_t)sysconf(_SC_PAGESIZE) - 1) & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+    if (size > arena_mapped) {
+        if (size > ARENA_MAX_SIZE ||
+            mmap((char*)arena + arena_mapped, size - arena_mapped,
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 arena_fd, (off_t)arena_mapped) == MAP_FAILED) {
+            log_message("Failed to extend string arena mapping to %zu bytes\n", size);
+            result = -1;
+        } else {
+            __atomic_store_n(&arena_mapped, size, __ATOMIC_RELEASE);
+        }
+    }
+    
+    pthread_mutex_unlock(&arena_map_lock);
+    return result;
+}
+
+/*
+ * Whether ref can name a block: inside the handed-out area and on a block
+ * boundary. Maps the block header in if another process grew the object.
+ */
+static int valid_ref(arena_ref_t ref) {
+    size_t size = __atomic_load_n(&arena->size, __ATOMIC_ACQUIRE);
+    
+    if (ref < blocks_start() || ref + sizeof(arena_block_t) > size ||
+        (ref - blocks_start()) % ARENA_MIN_BLOCK != 0) {
+        return 0;
+    }
+    return arena_map_to(ref + sizeof(arena_block_t)) == 0;
+}
+
+/* Lock the arena, recovering from a dead holder */
+static void lock_arena(void) {
+    if (pthread_mutex_lock(&arena->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&arena->lock);
+        log_message("Recovered string arena lock from a dead holder\n");
+    }
+    /* Follow growth by another process */
+    arena_map_to(arena->file_size);
+}
+
+/* Attach to the arena, creating it if needed; fresh discards a leftover one */
+int attach_string_arena(int fresh) {
+    struct stat st;
+    int created = 0;
+    int waited = 0;
+    
+    if (arena != NULL) {
+        return 0;
+    }
+    
+    if (fresh) {
+        shm_unlink(ARENA_SHM_NAME);
+    }
+    
+    arena_fd = shm_open(ARENA_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (arena_fd != -1) {
+        created = 1;
+        fchmod(arena_fd, 0666);
+        if (ftruncate(arena_fd, ARENA_INITIAL_SIZE) == -1) {
+            perror("ftruncate");
+            goto fail;
+        }
+    } else if (errno == EEXIST) {
+        arena_fd = shm_open(ARENA_SHM_NAME, O_RDWR, 0);
+    }
+    if (arena_fd == -1) {
+        perror("shm_open");
+        return -1;
+    }
+    
+    /* Wait for the creator to size it */
+    while (fstat(arena_fd, &st) == 0 && (size_t)st.st_size < sizeof(arena_header_t) && waited++ < 2000) {
+        usleep(1000);
+    }
+    if ((size_t)st.st_size < sizeof(arena_header_t)) {
+        log_message("String arena is not initialized\n");
+        goto fail;
+    }
+    
+    /* Reserve address space for the largest arena; map what exists now */
+    arena = (arena_header_t*)mmap(NULL, ARENA_MAX_SIZE, PROT_NONE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        perror("mmap reserve");
+        arena = NULL;
+        goto fail;
+    }
+    if (arena_map_to((size_t)st.st_size) == -1) {
+        munmap(arena, ARENA_MAX_SIZE);
+        arena = NULL;
+        goto fail;
+    }
+    
+    if (created) {
+        pthread_mutexattr_t attr;
+        
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&arena->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        
+        arena->size = blocks_start();
+        arena->file_size = ARENA_INITIAL_SIZE;
+        arena->next_stamp = 1;
+        __atomic_store_n(&arena->active, 1, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&arena->active, __ATOMIC_ACQUIRE) != 1 && waited++ < 2000) {
+            usleep(1000);
+        }
+        if (__atomic_load_n(&arena->active, __ATOMIC_ACQUIRE) != 1) {
+            log_message("String arena is not initialized\n");
+            detach_string_arena();
+            return -1;
+        }
+    }
+    return 0;
+
+fail:
+    close(arena_fd);
+    arena_fd = -1;
+    return -1;
+}
+
+/* Detach from the arena */
+void detach_string_arena(void) {
+    if (arena != NULL) {
+        munmap(arena, ARENA_MAX_SIZE);
+        arena = NULL;
+        arena_mapped = 0;
+    }
+    if (arena_fd != -1) {
+        close(arena_fd);
+        arena_fd = -1;
+    }
+}
+
+/* Detach and remove the arena */
+void destroy_string_arena(void) {
+    detach_string_arena();
+    shm_unlink(ARENA_SHM_NAME);
+}
+
+/* FNV-1a */
+static unsigned int hash_string(const char *str, size_t length) {
+    unsigned int hash = 2166136261u;
+    
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Take a block of a size class (caller holds the lock); 0 when the arena is full */
+static arena_ref_t alloc_block(unsigned int size_class) {
+    size_t block_size = (size_t)ARENA_MIN_BLOCK << size_class;
+    arena_ref_t ref = arena->free_head[size_class];
+    
+    /* Reuse the oldest freed block once no reader can still be in it */
+    if (ref != 0 && monotonic_now() - block_at(ref)->freed_at >= ARENA_REUSE_DELAY) {
+        arena->free_head[size_class] = block_at(ref)->next;
+        if (arena->free_head[size_class] == 0) {
+            arena->free_tail[size_class] = 0;
+        }
+        return ref;
+    }
+    
+    if (arena->size + block_size > arena->file_size) {
+        size_t file_size = arena->file_size;
+        
+        while (file_size < arena->size + block_size) {
+            file_size *= 2;
+        }
+        if (file_size > ARENA_MAX_SIZE || ftruncate(arena_fd, (off_t)file_size) == -1 ||
+            arena_map_to(file_size) == -1) {
+            log_message("String arena full (%zu bytes)\n", arena->file_size);
+            return 0;
+        }
+        arena->file_size = file_size;
+    }
+    
+    ref = arena->size;
+    __atomic_store_n(&arena->size, arena->size + block_size, __ATOMIC_RELEASE);
+    return ref;
+}
+
+/*
+ * Intern a string: return the block already holding the same bytes, or copy
+ * them into a new one. Either way the caller owns one reference, released
+ * with arena_release(). Strings longer than the largest block are cut.
+ * Returns 0 if the arena is unavailable or full.
+ */
+arena_ref_t arena_intern(const char *str, size_t length, unsigned long *stamp) {
+    unsigned int size_class = 0;
+    unsigned int hash;
+    arena_ref_t ref;
+    
+    if (arena == NULL || str == NULL) return 0;
+    
+    while (size_class < ARENA_CLASSES - 1 &&
+           ((size_t)ARENA_MIN_BLOCK << size_class) < sizeof(arena_block_t) + length + 1) {
+        size_class++;
+    }
+    if (sizeof(arena_block_t) + length + 1 > ((size_t)ARENA_MIN_BLOCK << size_class)) {
+        length = ((size_t)ARENA_MIN_BLOCK << size_class) - sizeof(arena_block_t) - 1;
+    }
+    hash = hash_string(str, length);
+    
+    lock_arena();
+    arena->intern_calls++;
+    
+    for (ref = arena->buckets[hash & (ARENA_BUCKETS - 1)]; ref != 0; ref = block_at(ref)->next) {
+        arena_block_t *block = block_at(ref);
+        
+        if (block->hash == hash && block->length == length && memcmp(block->data, str, length) == 0) {
+            block->refs++;
+            arena->intern_hits++;
+            if (stamp != NULL) *stamp = block->stamp;
+            pthread_mutex_unlock(&arena->lock);
+            return ref;
+        }
+    }
+    
+    ref = alloc_block(size_class);
+    if (ref != 0) {
+        arena_block_t *block = block_at(ref);
+        
+        block->refs = 1;
+        block->hash = hash;
+        block->length = (unsigned int)length;
+        block->size_class = size_class;
+        block->stamp = arena->next_stamp++;
+        memcpy(block->data, str, length);
+        block->data[length] = '\0';
+        block->next = arena->buckets[hash & (ARENA_BUCKETS - 1)];
+        arena->buckets[hash & (ARENA_BUCKETS - 1)] = ref;
+        
+        arena->strings++;
+        arena->live_bytes += (size_t)ARENA_MIN_BLOCK << size_class;
+        if (stamp != NULL) *stamp = block->stamp;
+    }
+    
+    pthread_mutex_unlock(&arena->lock);
+    return ref;
+}
+
+/*
+ * Reference of an interned string, without taking a reference: for
+ * comparing against table entries (equal strings have equal references).
+ * Returns 0 if no such string is interned.
+ */
+arena_ref_t arena_find(const char *str, size_t length) {
+    unsigned int hash = hash_string(str, length);
+    arena_ref_t ref;
+    
+    if (arena == NULL || str == NULL) return 0;
+    
+    lock_arena();
+    
+    for (ref = arena->buckets[hash & (ARENA_BUCKETS - 1)]; ref != 0; ref = block_at(ref)->next) {
+        arena_block_t *block = block_at(ref);
+        
+        if (block->hash == hash && block->length == length && memcmp(block->data, str, length) == 0) {
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&arena->lock);
+    return ref;
+}
+
+/*
+ * Take another reference to a string someone else holds, provided it is
+ * still the allocation identified by stamp. Returns 0 on success, -1 if
+ * the string was released (or its block reused) meanwhile.
+ */
+int arena_retain(arena_ref_t ref, unsigned long stamp) {
+    int result = -1;
+    
+    if (arena == NULL || ref == 0) return -1;
+    
+    lock_arena();
+    
+    if (valid_ref(ref)) {
+        arena_block_t *block = block_at(ref);
+        
+        if (block->refs > 0 && block->stamp == stamp) {
+            block->refs++;
+            result = 0;
+        }
+    }
+    
+    pthread_mutex_unlock(&arena->lock);
+    return result;
+}
+
+/* Drop a reference; the last one unlinks the string and queues its block */
+void arena_release(arena_ref_t ref) {
+    if (arena == NULL || ref == 0) return;
+    
+    lock_arena();
+    
+    if (valid_ref(ref) && block_at(ref)->refs > 0) {
+        arena_block_t *block = block_at(ref);
+        
+        if (--block->refs == 0) {
+            arena_ref_t *link = &arena->buckets[block->hash & (ARENA_BUCKETS - 1)];
+            unsigned int size_class = block->size_class;
+            
+            while (*link != 0 && *link != ref) {
+                link = &block_at(*link)->next;
+            }
+            if (*link == ref) {
+                *link = block->next;
+            }
+            
+            arena->strings--;
+            arena->live_bytes -= (size_t)ARENA_MIN_BLOCK << size_class;
+            
+            block->next = 0;
+            block->freed_at = monotonic_now();
+            if (arena->free_tail[size_class] != 0) {
+                block_at(arena->free_tail[size_class])->next = ref;
+            } else {
+                arena->free_head[size_class] = ref;
+            }
+            arena->free_tail[size_class] = ref;
+        }
+    }
+    
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * Block of a reference for a lock-free reader, with its length clamped to
+ * the block and the whole string mapped; NULL if ref cannot be a block.
+ */
+static const arena_block_t* read_block(arena_ref_t ref, size_t *length) {
+    const arena_block_t *block;
+    size_t capacity;
+    
+    if (arena == NULL || ref == 0 || !valid_ref(ref)) return NULL;
+    
+    block = block_at(ref);
+    capacity = ((size_t)ARENA_MIN_BLOCK << (block->size_class % ARENA_CLASSES)) - sizeof(arena_block_t) - 1;
+    *length = block->length < capacity ? block->length : capacity;
+    
+    if (arena_map_to(ref + sizeof(arena_block_t) + *length + 1) == -1) return NULL;
+    return block;
+}
+
+/*
+ * Copy a string into buf (truncated to size - 1 bytes) without taking the
+ * lock. Returns the full length. Callers hold a reference or validate the
+ * copy against a sequence number, as table readers do.
+ */
+size_t arena_copy(arena_ref_t ref, char *buf, size_t size) {
+    const arena_block_t *block;
+    size_t length, n;
+    
+    if (size == 0) return 0;
+    
+    block = read_block(ref, &length);
+    if (block == NULL) {
+        buf[0] = '\0';
+        return 0;
+    }
+    
+    n = length < size - 1 ? length : size - 1;
+    memcpy(buf, block->data, n);
+    buf[n] = '\0';
+    return length;
+}
+
+/* Length of a string; 0 for no string */
+size_t arena_length(arena_ref_t ref) {
+    size_t length;
+    
+    return read_block(ref, &length) != NULL ? length : 0;
+}
+
+/* Allocation stamp of a string, for arena_retain() */
+unsigned long arena_stamp(arena_ref_t ref) {
+    size_t length;
+    const arena_block_t *block = read_block(ref, &length);
+    
+    return block != NULL ? block->stamp : 0;
+}
+
+/* Whether a held string equals str */
+int arena_equals(arena_ref_t ref, const char *str) {
+    size_t length;
+    const arena_block_t *block = read_block(ref, &length);
+    
+    return block != NULL && strlen(str) == length && memcmp(block->data, str, length) == 0;
+}
+
+/* Copy the arena counters */
+void get_arena_stats(arena_stats_t *stats) {
+    if (stats == NULL) return;
+    
+    memset(stats, 0, sizeof(*stats));
+    if (arena == NULL) return;
+    
+    stats->strings = __atomic_load_n(&arena->strings, __ATOMIC_RELAXED);
+    stats->live_bytes = __atomic_load_n(&arena->live_bytes, __ATOMIC_RELAXED);
+    stats->size = __atomic_load_n(&arena->size, __ATOMIC_RELAXED);
+    stats->intern_calls = __atomic_load_n(&arena->intern_calls, __ATOMIC_RELAXED);
+    stats->intern_hits = __atomic_load_n(&arena->intern_hits, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,34 @@
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include "common.h"
+
+#define ARENA_SHM_NAME "/psx_strings"
+#define ARENA_INITIAL_SIZE (1024 * 1024)
+#define ARENA_MAX_SIZE (512UL * 1024 * 1024)  /* Address space reserved per mapping */
+#define ARENA_REUSE_DELAY 2.0       /* Seconds a freed block waits before reuse */
+
+/* String Arena Counters */
+typedef struct {
+    unsigned long strings;          /* Live interned strings */
+    unsigned long live_bytes;       /* Bytes of their blocks */
+    size_t size;                    /* Bytes handed out from the object */
+    unsigned long intern_calls;
+    unsigned long intern_hits;      /* Answered by an existing string */
+} arena_stats_t;
+
+/* String Arena Functions */
+int attach_string_arena(int fresh);
+void detach_string_arena(void);
+void destroy_string_arena(void);
+arena_ref_t arena_intern(const char *str, size_t length, unsigned long *stamp);
+arena_ref_t arena_find(const char *str, size_t length);
+int arena_retain(arena_ref_t ref, unsigned long stamp);
+void arena_release(arena_ref_t ref);
+size_t arena_copy(arena_ref_t ref, char *buf, size_t size);
+size_t arena_length(arena_ref_t ref);
+unsigned long arena_stamp(arena_ref_t ref);
+int arena_equals(arena_ref_t ref, const char *str);
+void get_arena_stats(arena_stats_t *stats);
+
+#endif /* STRING_ARENA_H */
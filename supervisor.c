@@ -1,110 +1,292 @@
 #include "supervisor.h"
 #include "process_table.h"
 #include "logger.h"
+#include "stats.h"
+#include "fd_cache.h"
+#include "cmdline_cache.h"
+#include "proc_reader.h"
+#include "managed.h"
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+
+/* Parent PIDs of the zombie entries one sweep found */
+typedef struct {
+    pid_t *ppids;
+    int count;
+    int capacity;
+} zombie_sweep_t;
 
 static pthread_t supervisor_tid;
 static int supervisor_running = 0;
+static int wake_fd = -1;          /* Written by cleanup_supervisor() to end the wait */
+
+/* Holders found by the previous sweep, sorted by PID (supervisor thread only) */
+static zombie_holder_t *holders = NULL;
+static int holder_count = 0;
+static unsigned long long reaped_children = 0;
+
+static double monotonic_now(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Drop the per-process state kept outside the table */
+static void forget_process(pid_t pid) {
+    forget_cpu_sample(pid);
+    evict_proc_fds(pid);
+    forget_process_strings(pid);
+}
 
-/* Check if process is a zombie */
-int check_zombie(pid_t pid) {
-    char stat_path[MAX_PATH_LEN];
-    FILE *fp;
-    char state_char;
-    int pid_read;
+/*
+ * Reap every exited child of the daemon. Each one is first looked at
+ * without reaping it (WNOWAIT), so its PID cannot be reused while its
+ * table entry is read; that exact entry is dropped once it is reaped.
+ */
+static void reap_children(process_table_t *table) {
+    siginfo_t info;
+    process_info_t entry;
+    char result[64];
     
-    snprintf(stat_path, sizeof(stat_path), "/proc/%d/stat", pid);
-    fp = fopen(stat_path, "r");
-    if (fp == NULL) {
-        return 0;  /* Process doesn't exist */
+    for (;;) {
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid == 0) {
+            break;  /* No children, or none has exited */
+        }
+        
+        pid_t pid = info.si_pid;
+        int known = get_process(table, pid, &entry) == 0;
+        
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG) != 0 || info.si_pid != pid) {
+            break;
+        }
+        
+        if (info.si_code == CLD_EXITED) {
+            snprintf(result, sizeof(result), "Exited with status %d", info.si_status);
+        } else {
+            snprintf(result, sizeof(result), "Killed by signal %d", info.si_status);
+        }
+        log_operation("ZOMBIE_REAP", pid, result);
+        reaped_children++;
+        
+        if (known) {
+            remove_process_instance(table, pid, entry.starttime);
+        }
+        forget_process(pid);
+        handle_managed_exit(pid, &info);
     }
     
-    /* Read state from stat file */
-    if (fscanf(fp, "%d %*s %c", &pid_read, &state_char) != 2) {
-        fclose(fp);
-        return 0;
+    table->zombie_stats.reaped = reaped_children;
+}
+
+/*
+ * React to the exit of the process started at starttime once its pidfd
+ * became readable, without reading /proc here. The entry is flagged dirty
+ * like on an exit event: the readers' next refresh records a zombie or
+ * drops a process already reaped. The exit event may come before the task
+ * is a zombie, so this second flag is what makes the refresh see state Z.
+ * The daemon's own children are reaped by the supervisor loop on SIGCHLD.
+ */
+void handle_process_exit(pid_t pid, unsigned long long starttime) {
+    process_table_t *table = attach_shared_memory();
+    process_info_t info;
+    
+    if (get_process(table, pid, &info) == 0 && info.starttime == starttime) {
+        mark_process_dirty(table, pid);
     }
-    fclose(fp);
+}
+
+/* Collect the parents of zombie entries in one range of the table */
+static void collect_zombies(const process_info_t *entries, int count, void *ctx) {
+    zombie_sweep_t *sweep = (zombie_sweep_t*)ctx;
     
-    return (state_char == 'Z');
+    for (int i = 0; i < count; i++) {
+        if (entries[i].state != PROC_ZOMBIE) continue;
+        
+        if (sweep->count == sweep->capacity) {
+            int new_capacity = sweep->capacity ? sweep->capacity * 2 : 64;
+            pid_t *grown = (pid_t*)realloc(sweep->ppids, new_capacity * sizeof(pid_t));
+            if (grown == NULL) return;
+            sweep->ppids = grown;
+            sweep->capacity = new_capacity;
+        }
+        sweep->ppids[sweep->count++] = entries[i].ppid;
+    }
 }
 
-/* Reap zombie process */
-void reap_zombie(pid_t pid) {
-    int status;
-    pid_t result;
+static int compare_pids(const void *a, const void *b) {
+    pid_t pa = *(const pid_t*)a;
+    pid_t pb = *(const pid_t*)b;
     
-    /* Try to reap the zombie */
-    result = waitpid(pid, &status, WNOHANG);
+    return (pa > pb) - (pa < pb);
+}
+
+/* Negative when a ranks first: most zombies, then held the longest */
+static int compare_holders(const zombie_holder_t *a, const zombie_holder_t *b) {
+    if (a->zombies != b->zombies) return a->zombies > b->zombies ? -1 : 1;
+    return (a->since > b->since) - (a->since < b->since);
+}
+
+/* Publish the sweep's counts and top holders in the segment */
+static void publish_zombie_stats(process_table_t *table, int zombies, time_t now) {
+    zombie_stats_t *stats = &table->zombie_stats;
+    zombie_holder_t top[ZOMBIE_TOP_HOLDERS];
+    int n = 0;
     
-    if (result > 0) {
-        log_operation("ZOMBIE_REAP", pid, "Success");
-        log_message("Reaped zombie process %d\n", pid);
+    /* Insertion into a short sorted list: the holder list is usually tiny */
+    for (int i = 0; i < holder_count; i++) {
+        int pos = n < ZOMBIE_TOP_HOLDERS ? n++ : ZOMBIE_TOP_HOLDERS;
         
-        /* Remove from process table */
-        process_table_t *table = attach_shared_memory();
-        if (table != NULL) {
-            remove_process(table, pid);
+        while (pos > 0 && compare_holders(&holders[i], &top[pos - 1]) < 0) {
+            if (pos < ZOMBIE_TOP_HOLDERS) top[pos] = top[pos - 1];
+            pos--;
         }
-    } else if (result == 0) {
-        /* Process still exists but not a zombie yet */
-    } else {
-        /* Error or process doesn't exist */
-        if (errno != ECHILD) {
-            log_message("Error reaping process %d: %s\n", pid, strerror(errno));
+        if (pos < ZOMBIE_TOP_HOLDERS) top[pos] = holders[i];
+    }
+    
+    memset(stats->top, 0, sizeof(stats->top));
+    memcpy(stats->top, top, n * sizeof(zombie_holder_t));
+    stats->zombies = zombies;
+    stats->holders = holder_count;
+    stats->last_sweep = now;
+}
+
+/*
+ * Find zombies from the state the readers already sampled into the table,
+ * without reading /proc, and record which parents hold them. A parent is
+ * logged when it starts holding zombies, so it can be alerted on. A
+ * zombie reaped since is dropped by the readers' next full scan.
+ */
+static void sweep_zombies(process_table_t *table, zombie_sweep_t *sweep) {
+    zombie_holder_t *current = NULL;
+    int current_count = 0;
+    time_t now = time(NULL);
+    char result[64];
+    
+    sweep->count = 0;
+    if (scan_table(table, collect_zombies, sweep) != 0) {
+        return;
+    }
+    
+    qsort(sweep->ppids, sweep->count, sizeof(pid_t), compare_pids);
+    if (sweep->count > 0) {
+        current = (zombie_holder_t*)malloc(sweep->count * sizeof(zombie_holder_t));
+        if (current == NULL) return;
+    }
+    
+    /* One holder per distinct parent; the previous list is sorted the same way */
+    for (int i = 0, prev = 0; i < sweep->count; ) {
+        zombie_holder_t *holder = &current[current_count++];
+        
+        holder->ppid = sweep->ppids[i];
+        holder->zombies = 0;
+        while (i < sweep->count && sweep->ppids[i] == holder->ppid) {
+            holder->zombies++;
+            i++;
+        }
+        
+        while (prev < holder_count && holders[prev].ppid < holder->ppid) prev++;
+        if (prev < holder_count && holders[prev].ppid == holder->ppid) {
+            holder->since = holders[prev].since;
+        } else {
+            holder->since = now;
+            snprintf(result, sizeof(result), "Holding %d zombie(s)", holder->zombies);
+            log_operation("ZOMBIE_HOLDER", holder->ppid, result);
+            log_message("PID %d is holding %d zombie process(es)\n", holder->ppid, holder->zombies);
         }
     }
+    
+    free(holders);
+    holders = current;
+    holder_count = current_count;
+    
+    publish_zombie_stats(table, sweep->count, now);
 }
 
-/* Supervisor thread function */
+/*
+ * Supervisor thread: an event loop on a signalfd for SIGCHLD, which the
+ * daemon keeps blocked in every thread, and an eventfd written at
+ * shutdown. Exited children are reaped as soon as they are reported, and
+ * managed ones restarted; otherwise the wait ends only when a managed
+ * child's backoff delay does or the next zombie sweep of the table, every
+ * SUPERVISOR_SWEEP_SECS, is due.
+ */
 void* zombie_cleanup_thread(void *arg) {
     process_table_t *table;
-    time_t last_scan = 0;
-    const int scan_interval = 5;  /* Scan every 5 seconds */
+    zombie_sweep_t sweep;
+    sigset_t child_signal;
+    struct pollfd pfds[2];
+    struct signalfd_siginfo pending[16];
+    double next_sweep = 0;
+    (void)arg;
     
     table = attach_shared_memory();
     if (table == NULL) {
         return NULL;
     }
     
+    memset(&sweep, 0, sizeof(sweep));
+    sigemptyset(&child_signal);
+    sigaddset(&child_signal, SIGCHLD);
+    pfds[0].fd = signalfd(-1, &child_signal, SFD_NONBLOCK | SFD_CLOEXEC);
+    pfds[0].events = POLLIN;
+    pfds[1].fd = wake_fd;
+    pfds[1].events = POLLIN;
+    if (pfds[0].fd == -1) {
+        log_message("signalfd unavailable (%s), polling for exited children\n", strerror(errno));
+    }
+    
     log_message("Supervisor thread started\n");
     
+    /* Children that exited before the signalfd existed */
+    reap_children(table);
+    
     while (supervisor_running) {
-        sleep(1);
+        double now = monotonic_now();
+        if (now >= next_sweep) {
+            sweep_zombies(table, &sweep);
+            next_sweep = now + SUPERVISOR_SWEEP_SECS;
+        }
+        
+        int timeout = (int)((next_sweep - now) * 1000) + 1;
+        int restart = next_managed_restart_ms();
+        if (restart >= 0 && restart < timeout) {
+            timeout = restart;
+        }
+        /* Without either descriptor, fall back to polling */
+        if ((pfds[0].fd == -1 || pfds[1].fd == -1) && timeout > SUPERVISOR_POLL_MS) {
+            timeout = SUPERVISOR_POLL_MS;
+        }
         
-        time_t current_time = time(NULL);
+        /* A negative fd is skipped, so without a signalfd this just waits */
+        pfds[0].revents = pfds[1].revents = 0;
+        int ready = poll(pfds, 2, timeout);
         
-        /* Scan for zombies periodically */
-        if (current_time - last_scan >= scan_interval) {
-            lock_table();
-            
-            /* Scan all processes in table */
-            for (int i = 0; i < table->count; i++) {
-                process_info_t *proc = &table->processes[i];
-                
-                if (proc->pid == 0) continue;
-                
-                /* Check if process is zombie */
-                if (check_zombie(proc->pid)) {
-                    log_message("Found zombie process: PID %d\n", proc->pid);
-                    unlock_table();
-                    
-                    /* Reap the zombie */
-                    reap_zombie(proc->pid);
-                    
-                    lock_table();
-                }
+        if (ready > 0 && pfds[1].revents != 0) {
+            break;
+        }
+        if (ready > 0) {
+            /* Drain the queued signals; they coalesce, so every exited child is waited for below */
+            while (read(pfds[0].fd, pending, sizeof(pending)) > 0) {
             }
-            
-            unlock_table();
-            last_scan = current_time;
         }
-        
-        /* Also try to reap any zombie children in a non-blocking way */
-        while (waitpid(-1, NULL, WNOHANG) > 0) {
-            /* Reaped a zombie child */
+        if (ready > 0 || pfds[0].fd == -1) {
+            reap_children(table);
         }
+        restart_managed_due();
+    }
+    
+    if (pfds[0].fd != -1) {
+        close(pfds[0].fd);
     }
+    free(sweep.ppids);
+    free(holders);
+    holders = NULL;
+    holder_count = 0;
     
     log_message("Supervisor thread stopped\n");
     return NULL;
@@ -116,11 +298,18 @@ void init_supervisor(void) {
         return;
     }
     
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        log_message("eventfd unavailable (%s), supervisor polls for shutdown\n", strerror(errno));
+    }
+    
     supervisor_running = 1;
     
     if (pthread_create(&supervisor_tid, NULL, zombie_cleanup_thread, NULL) != 0) {
         perror("pthread_create supervisor");
         supervisor_running = 0;
+        if (wake_fd != -1) close(wake_fd);
+        wake_fd = -1;
         return;
     }
     
@@ -129,13 +318,20 @@ void init_supervisor(void) {
 
 /* Cleanup supervisor */
 void cleanup_supervisor(void) {
+    uint64_t one = 1;
+    
     if (!supervisor_running) {
         return;
     }
     
     supervisor_running = 0;
+    if (wake_fd != -1 && write(wake_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+        log_message("Supervisor wake-up failed: %s\n", strerror(errno));
+    }
     pthread_join(supervisor_tid, NULL);
     
+    if (wake_fd != -1) close(wake_fd);
+    wake_fd = -1;
+    
     log_message("Supervisor cleaned up\n");
 }
-
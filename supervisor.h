@@ -3,12 +3,13 @@
 
 #include "common.h"
 
+#define SUPERVISOR_SWEEP_SECS 5     /* Seconds between zombie sweeps of the table */
+#define SUPERVISOR_POLL_MS 500      /* Longest wait without a signalfd or eventfd */
+
 /* Supervisor Functions */
 void init_supervisor(void);
 void cleanup_supervisor(void);
 void* zombie_cleanup_thread(void *arg);
-int check_zombie(pid_t pid);
-void reap_zombie(pid_t pid);
+void handle_process_exit(pid_t pid, unsigned long long starttime);
 
 #endif /* SUPERVISOR_H */
-
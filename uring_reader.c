@@ -0,0 +1,514 @@
+#include "uring_reader.h"
+#include "proc_reader.h"
+#include "stats.h"
+#include "fd_cache.h"
+#include "logger.h"
+#include "cmdline_cache.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define URING_ENTRIES 256           /* SQ size */
+#define URING_BATCH 256             /* PIDs per batch */
+#define URING_FILES 1               /* stat; cmdline comes from the cache */
+
+/* user_data layout: slot index << 2 | file << 1 */
+#define URING_DATA(slot, file) (((__u64)(slot) << 2) | ((__u64)(file) << 1))
+#define URING_SLOT(data) ((int)((data) >> 2))
+#define URING_FILE(data) ((int)(((data) >> 1) & 1))
+
+/* One PID in flight */
+typedef struct {
+    pid_t pid;
+    char path[URING_FILES][32];
+    int fd[URING_FILES];
+    int len[URING_FILES];
+    int pending;                    /* Reads still in flight */
+    int fallback;                   /* Open or read failed other than by exit: sample synchronously */
+    char stat_buf[1024];
+} uring_slot_t;
+
+/* A mapped ring plus the slots of the current batch */
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned queued;                /* SQEs not yet submitted */
+    uring_slot_t *slots;
+} uring_t;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static int uring_supported = -1;    /* -1 unknown, 0 no, 1 yes */
+
+/* Unmap and close a ring */
+static void destroy_ring(void *arg) {
+    uring_t *ring = (uring_t*)arg;
+    
+    if (ring == NULL) return;
+    
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd != -1) close(ring->fd);
+    free(ring->slots);
+    free(ring);
+}
+
+/* Create the per-thread ring key */
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, destroy_ring);
+}
+
+/* Set up a ring with the raw syscalls */
+static uring_t* create_ring(void) {
+    struct io_uring_params params;
+    uring_t *ring;
+    
+    ring = (uring_t*)calloc(1, sizeof(uring_t));
+    if (ring == NULL) return NULL;
+    
+    ring->slots = (uring_slot_t*)malloc(URING_BATCH * sizeof(uring_slot_t));
+    if (ring->slots == NULL) {
+        free(ring);
+        return NULL;
+    }
+    
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd == -1) {
+        destroy_ring(ring);
+        return NULL;
+    }
+    
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        destroy_ring(ring);
+        return NULL;
+    }
+    
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            destroy_ring(ring);
+            return NULL;
+        }
+    }
+    
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        destroy_ring(ring);
+        return NULL;
+    }
+    
+    char *sq = (char*)ring->sq_ring;
+    char *cq = (char*)ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    
+    return ring;
+}
+
+/* Get this thread's ring, creating it on first use */
+static uring_t* get_ring(void) {
+    uring_t *ring;
+    
+    pthread_once(&ring_once, make_ring_key);
+    
+    ring = (uring_t*)pthread_getspecific(ring_key);
+    if (ring == NULL) {
+        ring = create_ring();
+        if (ring != NULL) {
+            pthread_setspecific(ring_key, ring);
+        }
+    }
+    return ring;
+}
+
+/* Queue one SQE; the ring is sized so a batch phase always fits */
+static struct io_uring_sqe* queue_sqe(uring_t *ring) {
+    unsigned tail = *ring->sq_tail + ring->queued;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+static void reap_completions(uring_t *ring, unsigned expected, int reading,
+                             const system_snapshot_t *sys,
+                             sample_callback_t callback, void *ctx);
+
+/* Submit queued SQEs and wait for wait_nr completions */
+static int submit_and_wait(uring_t *ring, unsigned wait_nr) {
+    unsigned submit = ring->queued;
+    long ret;
+    
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + submit, __ATOMIC_RELEASE);
+    ring->queued = 0;
+    
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, submit, wait_nr,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (ret == -1 && errno == EINTR);
+    
+    count_proc_syscalls(1);
+    return ret == -1 || (unsigned)ret < submit ? -1 : 0;
+}
+
+/*
+ * After a failed submission, wait for and reap whatever the kernel did
+ * take, and take back the SQEs it did not, so nothing of this batch is
+ * submitted or completed with the next one. head is the SQ head before
+ * the submission. Returns how many SQEs the kernel took.
+ */
+static unsigned recover_submission(uring_t *ring, unsigned head, int reading,
+                                   const system_snapshot_t *sys,
+                                   sample_callback_t callback, void *ctx) {
+    unsigned taken = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) - head;
+    
+    if (taken > 0) {
+        long ret;
+        do {
+            ret = syscall(__NR_io_uring_enter, ring->fd, 0, taken, IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (ret == -1 && errno == EINTR);
+        count_proc_syscalls(1);
+        reap_completions(ring, taken, reading, sys, callback, ctx);
+    }
+    
+    __atomic_store_n(ring->sq_tail, head + taken, __ATOMIC_RELEASE);
+    return taken;
+}
+
+/* Finish a slot whose reads are all complete */
+static void finish_slot(uring_slot_t *slot, const system_snapshot_t *sys,
+                        sample_callback_t callback, void *ctx) {
+    process_info_t info;
+    
+    if (slot->len[0] <= 0) {
+        return;  /* Exited before its stat could be read */
+    }
+    
+    memset(&info, 0, sizeof(info));
+    slot->stat_buf[slot->len[0]] = '\0';
+    if (parse_process_stat(slot->stat_buf, sys, &info) != 0) {
+        return;
+    }
+    
+    /* Synchronous read only on first sight or after an exec */
+    fill_process_strings(&info);
+    update_process_statistics(&info, sys);
+    callback(&info, ctx);
+}
+
+/* Reap completions; on_read finishes slots as their reads arrive */
+static void reap_completions(uring_t *ring, unsigned expected, int reading,
+                             const system_snapshot_t *sys,
+                             sample_callback_t callback, void *ctx) {
+    unsigned head = *ring->cq_head;
+    unsigned reaped = 0;
+    
+    while (reaped < expected) {
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        
+        if (head == tail) {
+            /* Everything waited for has arrived unless submission failed */
+            break;
+        }
+        
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        uring_slot_t *slot = &ring->slots[URING_SLOT(cqe->user_data)];
+        int file = URING_FILE(cqe->user_data);
+        
+        if (reading) {
+            slot->len[file] = cqe->res;
+            if (cqe->res < 0 && cqe->res != -ESRCH) {
+                slot->fallback = 1;
+            }
+            if (--slot->pending == 0 && !slot->fallback) {
+                finish_slot(slot, sys, callback, ctx);
+            }
+        } else if (slot->fd[file] == -2) {
+            /* Completion of an OPENAT; ENOENT means the process is gone */
+            slot->fd[file] = cqe->res >= 0 ? cqe->res : -1;
+            if (cqe->res < 0 && cqe->res != -ENOENT && cqe->res != -ESRCH) {
+                slot->fallback = 1;
+            }
+        }
+        
+        head++;
+        reaped++;
+    }
+    
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Sample one batch: open, read and close every stat file in three
+ * submissions. A PID whose open or read fails for any reason but its exit
+ * is sampled synchronously afterwards. Returns -1, before any callback,
+ * when the opens could not be submitted or every one was refused; the
+ * caller then samples the whole batch synchronously.
+ */
+static int scan_batch(uring_t *ring, const pid_t *pids, int count,
+                      const system_snapshot_t *sys,
+                      sample_callback_t callback, void *ctx) {
+    unsigned submitted = 0, taken, head;
+    int opened = 0, refused = 0;
+    
+    /* Phase 1: open the stat file of every PID */
+    for (int i = 0; i < count; i++) {
+        uring_slot_t *slot = &ring->slots[i];
+        slot->pid = pids[i];
+        slot->pending = 0;
+        slot->fallback = 0;
+        
+        for (int f = 0; f < URING_FILES; f++) {
+            struct io_uring_sqe *sqe = queue_sqe(ring);
+            
+            snprintf(slot->path[f], sizeof(slot->path[f]), "/proc/%d/stat", pids[i]);
+            slot->fd[f] = -2;
+            slot->len[f] = -1;
+            
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)slot->path[f];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = URING_DATA(i, f);
+            submitted++;
+        }
+    }
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (submit_and_wait(ring, submitted) != 0) {
+        /* Close what the opens the kernel took returned; the caller redoes the batch */
+        recover_submission(ring, head, 0, sys, callback, ctx);
+        for (int i = 0; i < count; i++) {
+            for (int f = 0; f < URING_FILES; f++) {
+                if (ring->slots[i].fd[f] >= 0) {
+                    close(ring->slots[i].fd[f]);
+                    count_proc_syscalls(1);
+                }
+                ring->slots[i].fd[f] = -1;
+            }
+        }
+        return -1;
+    }
+    reap_completions(ring, submitted, 0, sys, callback, ctx);
+    
+    for (int i = 0; i < count; i++) {
+        for (int f = 0; f < URING_FILES; f++) {
+            if (ring->slots[i].fd[f] >= 0) opened++;
+        }
+        if (ring->slots[i].fallback) refused++;
+    }
+    if (opened == 0 && refused > 0) {
+        /* Opens are refused outright (LSM, seccomp on io-wq): stop using io_uring */
+        log_message("io_uring opens refused, using sync reads\n");
+        uring_supported = 0;
+        return -1;
+    }
+    
+    /* Phase 2: read whatever opened; slots finish as their reads complete */
+    submitted = 0;
+    for (int i = 0; i < count; i++) {
+        uring_slot_t *slot = &ring->slots[i];
+        
+        for (int f = 0; f < URING_FILES; f++) {
+            if (slot->fd[f] < 0) continue;
+            
+            struct io_uring_sqe *sqe = queue_sqe(ring);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = slot->fd[f];
+            sqe->addr = (unsigned long)slot->stat_buf;
+            sqe->len = sizeof(slot->stat_buf) - 1;
+            sqe->off = 0;
+            sqe->user_data = URING_DATA(i, f);
+            slot->pending++;
+            submitted++;
+        }
+    }
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (submitted > 0) {
+        if (submit_and_wait(ring, submitted) == 0) {
+            reap_completions(ring, submitted, 1, sys, callback, ctx);
+        } else {
+            recover_submission(ring, head, 1, sys, callback, ctx);
+        }
+    }
+    
+    /* Phase 3: close everything that opened */
+    submitted = 0;
+    for (int i = 0; i < count; i++) {
+        for (int f = 0; f < URING_FILES; f++) {
+            if (ring->slots[i].fd[f] < 0) continue;
+            
+            struct io_uring_sqe *sqe = queue_sqe(ring);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = ring->slots[i].fd[f];
+            sqe->user_data = URING_DATA(i, f);
+            submitted++;
+        }
+    }
+    taken = submitted;
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (submitted > 0) {
+        if (submit_and_wait(ring, submitted) == 0) {
+            reap_completions(ring, submitted, 0, sys, callback, ctx);
+        } else {
+            taken = recover_submission(ring, head, 0, sys, callback, ctx);
+        }
+    }
+    
+    /* Closes the kernel did not take are done here, in the same order */
+    for (int i = 0, queued = 0; i < count; i++) {
+        for (int f = 0; f < URING_FILES; f++) {
+            if (ring->slots[i].fd[f] < 0) continue;
+            if ((unsigned)queued++ >= taken) {
+                close(ring->slots[i].fd[f]);
+                count_proc_syscalls(1);
+            }
+            ring->slots[i].fd[f] = -1;
+        }
+    }
+    
+    /* Phase 4: PIDs io_uring could not sample */
+    for (int i = 0; i < count; i++) {
+        uring_slot_t *slot = &ring->slots[i];
+        process_info_t info;
+        
+        if ((slot->fallback || slot->pending > 0) && sample_process(slot->pid, sys, &info) == 0) {
+            callback(&info, ctx);
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * Whether every opcode the reader submits is supported, asked through
+ * IORING_REGISTER_PROBE. The probe and these opcodes both arrived in
+ * Linux 5.6, so a kernel without the probe cannot run the reader either.
+ */
+static int probe_opcodes(uring_t *ring) {
+    static const int needed[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+    struct io_uring_probe *probe;
+    int supported = 1;
+    
+    probe = (struct io_uring_probe*)calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL) {
+        return 0;
+    }
+    
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) != 0) {
+        supported = 0;
+    }
+    for (int i = 0; supported && i < (int)(sizeof(needed) / sizeof(needed[0])); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+            errno = EOPNOTSUPP;
+            supported = 0;
+        }
+    }
+    
+    free(probe);
+    return supported;
+}
+
+/* Whether io_uring can be used here (kernel support and opcodes, not blocked by seccomp) */
+int uring_reader_available(void) {
+    if (uring_supported == -1) {
+        uring_t *ring = get_ring();
+        
+        uring_supported = ring != NULL && probe_opcodes(ring);
+        if (!uring_supported) {
+            log_message("io_uring unavailable (%s)\n", strerror(errno));
+        }
+    }
+    return uring_supported;
+}
+
+/*
+ * Sample PIDs in batches of URING_BATCH. A batch io_uring could not
+ * handle at all is sampled synchronously. Returns -1 if io_uring is
+ * unusable, before sampling anything.
+ */
+int uring_scan_processes(const pid_t *pids, int count, const system_snapshot_t *sys,
+                         sample_callback_t callback, void *ctx) {
+    uring_t *ring;
+    
+    if (!uring_reader_available() || (ring = get_ring()) == NULL) {
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i += URING_BATCH) {
+        int batch = count - i < URING_BATCH ? count - i : URING_BATCH;
+        
+        if (scan_batch(ring, pids + i, batch, sys, callback, ctx) != 0) {
+            for (int j = i; j < i + batch; j++) {
+                process_info_t info;
+                if (sample_process(pids[j], sys, &info) == 0) {
+                    callback(&info, ctx);
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
+
+#else /* !HAVE_IO_URING */
+
+/* Built without io_uring headers */
+int uring_reader_available(void) {
+    return 0;
+}
+
+int uring_scan_processes(const pid_t *pids, int count, const system_snapshot_t *sys,
+                         sample_callback_t callback, void *ctx) {
+    (void)pids; (void)count; (void)sys; (void)callback; (void)ctx;
+    return -1;
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,12 @@
+#ifndef URING_READER_H
+#define URING_READER_H
+
+#include "common.h"
+#include "proc_reader.h"
+
+/* io_uring Reader Functions */
+int uring_reader_available(void);
+int uring_scan_processes(const pid_t *pids, int count, const system_snapshot_t *sys,
+                         sample_callback_t callback, void *ctx);
+
+#endif /* URING_READER_H */
@@ -0,0 +1,106 @@
+#include "work_queue.h"
+
+/* Initialize a deque */
+int init_work_deque(work_deque_t *dq, int capacity) {
+    dq->chunks = (work_chunk_t*)malloc(capacity * sizeof(work_chunk_t));
+    if (dq->chunks == NULL) {
+        return -1;
+    }
+    
+    dq->capacity = capacity;
+    dq->top = 0;
+    dq->bottom = 0;
+    pthread_mutex_init(&dq->lock, NULL);
+    return 0;
+}
+
+/* Destroy a deque */
+void destroy_work_deque(work_deque_t *dq) {
+    free(dq->chunks);
+    dq->chunks = NULL;
+    dq->capacity = 0;
+    pthread_mutex_destroy(&dq->lock);
+}
+
+/* Empty a deque */
+void reset_work_deque(work_deque_t *dq) {
+    pthread_mutex_lock(&dq->lock);
+    dq->top = 0;
+    dq->bottom = 0;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+/* Push a chunk at the bottom, growing the deque if needed */
+int push_work(work_deque_t *dq, work_chunk_t chunk) {
+    pthread_mutex_lock(&dq->lock);
+    
+    if (dq->bottom == dq->capacity) {
+        int used = dq->bottom - dq->top;
+        
+        if (dq->top > 0) {
+            /* Reclaim space left by stolen chunks */
+            memmove(dq->chunks, dq->chunks + dq->top, used * sizeof(work_chunk_t));
+        } else {
+            work_chunk_t *grown = (work_chunk_t*)realloc(dq->chunks,
+                                    dq->capacity * 2 * sizeof(work_chunk_t));
+            if (grown == NULL) {
+                pthread_mutex_unlock(&dq->lock);
+                return -1;
+            }
+            dq->chunks = grown;
+            dq->capacity *= 2;
+        }
+        dq->top = 0;
+        dq->bottom = used;
+    }
+    
+    dq->chunks[dq->bottom++] = chunk;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+/* Owner takes the most recently pushed chunk */
+int pop_work(work_deque_t *dq, work_chunk_t *chunk) {
+    int found = 0;
+    
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        *chunk = dq->chunks[--dq->bottom];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    
+    return found;
+}
+
+/* Thief takes the oldest chunk */
+int steal_work(work_deque_t *dq, work_chunk_t *chunk) {
+    int found = 0;
+    
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top) {
+        *chunk = dq->chunks[dq->top++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    
+    return found;
+}
+
+/*
+ * Take from our own deque, otherwise steal from the others in turn.
+ * Returns 1 for our own chunk, 2 for a stolen one, 0 if there is none.
+ */
+int find_work(work_deque_t *deques, int count, int self, work_chunk_t *chunk) {
+    if (pop_work(&deques[self], chunk)) {
+        return 1;
+    }
+    
+    for (int i = 1; i < count; i++) {
+        if (steal_work(&deques[(self + i) % count], chunk)) {
+            return 2;
+        }
+    }
+    
+    return 0;
+}
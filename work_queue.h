@@ -0,0 +1,31 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include "common.h"
+
+/* A run of PIDs handed to one worker at a time */
+typedef struct {
+    const pid_t *pids;
+    int count;
+    void *batch;              /* Pool-specific payload, or NULL */
+} work_chunk_t;
+
+/* Per-worker deque: the owner works at the bottom, thieves take from the top */
+typedef struct {
+    work_chunk_t *chunks;
+    int capacity;
+    int top;
+    int bottom;
+    pthread_mutex_t lock;
+} work_deque_t;
+
+/* Work Queue Functions */
+int init_work_deque(work_deque_t *dq, int capacity);
+void destroy_work_deque(work_deque_t *dq);
+void reset_work_deque(work_deque_t *dq);
+int push_work(work_deque_t *dq, work_chunk_t chunk);
+int pop_work(work_deque_t *dq, work_chunk_t *chunk);
+int steal_work(work_deque_t *dq, work_chunk_t *chunk);
+int find_work(work_deque_t *deques, int count, int self, work_chunk_t *chunk);
+
+#endif /* WORK_QUEUE_H */